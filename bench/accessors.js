@@ -0,0 +1,85 @@
+#!/usr/bin/env node
+// Measure the cost of a single call to each of the integer accessors,
+// with and without V8's fast API calls.
+//
+//   node bench/accessors.js [--calls=N]
+//
+// On versions of node where the addon registers fast versions of these
+// methods, the "slow" column is measured with --no-turbo-fast-api-calls.
+var childProcess = require('child_process');
+
+var calls = 1e7;
+process.argv.slice(2).forEach(function(arg) {
+    var m = /^--calls=(\d+)$/.exec(arg);
+    if (m) { calls = +m[1]; }
+});
+
+// Run in a child process: print nanoseconds per call for each method.
+var child = function() {
+    var ubidi = require('../');
+    var text = new Array(65).join('English עִבְרִית 123 ');
+    var p = ubidi.Paragraph(text);
+    p.countRuns(); // resolve the paragraph up front
+    var n = p.getLength();
+    var methods = {
+        getLength: function(i) { return p.getLength(); },
+        getLevelAt: function(i) { return p.getLevelAt(i % n); },
+        getVisualIndex: function(i) { return p.getVisualIndex(i % n); },
+        getLogicalIndex: function(i) { return p.getLogicalIndex(i % n); }
+    };
+    var result = {};
+    Object.keys(methods).forEach(function(name) {
+        var fn = methods[name], sum = 0, i;
+        // Warm up, so that the loop is optimized.
+        for (i = 0; i < 1e5; i++) { sum += fn(i); }
+        var start = process.hrtime();
+        for (i = 0; i < calls; i++) { sum += fn(i); }
+        var t = process.hrtime(start);
+        result[name] = (t[0] * 1e9 + t[1]) / calls;
+        if (sum < 0) { console.error(sum); } // keep the calls alive
+    });
+    console.log(JSON.stringify(result));
+};
+
+var run = function(flags) {
+    var env = {};
+    Object.keys(process.env).forEach(function(k) { env[k] = process.env[k]; });
+    env.ICU_BIDI_BENCH_CHILD = calls;
+    try {
+        return JSON.parse(childProcess.execFileSync(
+            process.execPath, flags.concat(__filename),
+            { env: env, stdio: ['ignore', 'pipe', 'ignore'] }
+        ));
+    } catch (e) {
+        return null; // node doesn't know the flag
+    }
+};
+
+var pad = function(s, n) {
+    s = String(s);
+    while (s.length < n) { s = ' ' + s; }
+    return s;
+};
+
+var main = function() {
+    var fast = run([]);
+    if (!fast) {
+        console.error('The benchmark failed; is the addon built?');
+        process.exit(1);
+    }
+    var slow = run(['--no-turbo-fast-api-calls']);
+    console.log('node ' + process.version + ', ns per call:');
+    console.log(pad('', 16) + pad('slow', 10) + pad('fast', 10));
+    Object.keys(fast).forEach(function(name) {
+        console.log(pad(name, 16) +
+                    pad(slow ? slow[name].toFixed(1) : 'n/a', 10) +
+                    pad(fast[name].toFixed(1), 10));
+    });
+};
+
+if (process.env.ICU_BIDI_BENCH_CHILD) {
+    calls = +process.env.ICU_BIDI_BENCH_CHILD;
+    child();
+} else {
+    main();
+}
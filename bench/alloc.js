@@ -0,0 +1,87 @@
+#!/usr/bin/env node
+// Measure the time and heap allocation of a single call to each of the
+// accessors which return an object.
+//
+//   node bench/alloc.js [--calls=N]
+//
+// The heap is measured in a child process run with --expose-gc, so that
+// garbage can be collected before and after each batch of calls.
+var childProcess = require('child_process');
+
+var calls = 1e6;
+process.argv.slice(2).forEach(function(arg) {
+    var m = /^--calls=(\d+)$/.exec(arg);
+    if (m) { calls = +m[1]; }
+});
+
+// Keep batches small enough that they don't trigger a collection.
+var BATCH = 1e4;
+
+// Run in a child process: print nanoseconds and bytes per call for each
+// method.
+var child = function() {
+    var ubidi = require('../');
+    var text = new Array(65).join('English עִבְרִית 123\n');
+    var p = ubidi.Paragraph(text);
+    var runs = p.countRuns(), n = p.getLength();
+    var paras = p.countParagraphs();
+    var methods = {
+        getVisualRun: function(i) { return p.getVisualRun(i % runs); },
+        getLogicalRun: function(i) { return p.getLogicalRun(i % n); },
+        getParagraph: function(i) { return p.getParagraph(i % n); },
+        getParagraphByIndex: function(i) {
+            return p.getParagraphByIndex(i % paras);
+        }
+    };
+    var result = {};
+    Object.keys(methods).forEach(function(name) {
+        var fn = methods[name], sum = 0, i;
+        // Warm up, so that the loop is optimized.
+        for (i = 0; i < 1e5; i++) { sum += fn(i).length || 0; }
+        var start = process.hrtime();
+        for (i = 0; i < calls; i++) { sum += fn(i).length || 0; }
+        var t = process.hrtime(start);
+        // Results are dropped right away, so count the bytes allocated
+        // by a batch of calls between collections.
+        var keep = new Array(BATCH);
+        global.gc();
+        var before = process.memoryUsage().heapUsed;
+        for (i = 0; i < BATCH; i++) { keep[i] = fn(i); }
+        var bytes = process.memoryUsage().heapUsed - before;
+        result[name] = {
+            ns: (t[0] * 1e9 + t[1]) / calls,
+            bytes: bytes / BATCH
+        };
+        if (sum < 0) { console.error(sum); } // keep the calls alive
+    });
+    console.log(JSON.stringify(result));
+};
+
+var pad = function(s, n) {
+    s = String(s);
+    while (s.length < n) { s = ' ' + s; }
+    return s;
+};
+
+var main = function() {
+    var env = {};
+    Object.keys(process.env).forEach(function(k) { env[k] = process.env[k]; });
+    env.ICU_BIDI_BENCH_CHILD = calls;
+    var result = JSON.parse(childProcess.execFileSync(
+        process.execPath, ['--expose-gc', __filename], { env: env }
+    ));
+    console.log('node ' + process.version + ', per call:');
+    console.log(pad('', 20) + pad('ns', 10) + pad('bytes', 10));
+    Object.keys(result).forEach(function(name) {
+        console.log(pad(name, 20) +
+                    pad(result[name].ns.toFixed(1), 10) +
+                    pad(result[name].bytes.toFixed(0), 10));
+    });
+};
+
+if (process.env.ICU_BIDI_BENCH_CHILD) {
+    calls = +process.env.ICU_BIDI_BENCH_CHILD;
+    child();
+} else {
+    main();
+}
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Benchmark the bundled copy of libicu against the system libicu.
+#
+#   bench/compare-icu.sh [ARGS FOR bench/index.js...]
+#
+# Rebuilds the module twice; it is left built against the bundled libicu.
+set -e
+cd "$(dirname "$0")/.."
+NODE_PRE_GYP=node_modules/.bin/node-pre-gyp
+OUT=${TMPDIR:-/tmp}/icu-bidi-bench.$$
+mkdir -p "$OUT"
+
+$NODE_PRE_GYP rebuild --libicu=external
+node bench --json "$@" > "$OUT/external.json"
+$NODE_PRE_GYP rebuild --libicu=internal
+node bench --json "$@" > "$OUT/internal.json"
+
+node bench/compare.js "$OUT/internal.json" "$OUT/external.json"
+rm -rf "$OUT"
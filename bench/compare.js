@@ -0,0 +1,37 @@
+#!/usr/bin/env node
+// Compare two sets of results written by `node bench --json`.
+//
+//   node bench/compare.js BEFORE.json AFTER.json
+var fs = require('fs');
+
+if (process.argv.length !== 4) {
+    console.error('Usage: node bench/compare.js BEFORE.json AFTER.json');
+    process.exit(1);
+}
+var load = function(file) { return JSON.parse(fs.readFileSync(file, 'utf8')); };
+var before = load(process.argv[2]), after = load(process.argv[3]);
+
+var pad = function(s, n, left) {
+    s = String(s);
+    while (s.length < n) { s = left ? ' ' + s : s + ' '; }
+    return s;
+};
+
+console.log('before: node ' + before.node + ', ICU ' + before.icu);
+console.log('after:  node ' + after.node + ', ICU ' + after.icu);
+var index = {};
+before.results.forEach(function(r) { index[r.corpus + '/' + r.bench] = r; });
+var corpus = null;
+after.results.forEach(function(r) {
+    var b = index[r.corpus + '/' + r.bench];
+    if (!b) { return; }
+    if (r.corpus !== corpus) {
+        corpus = r.corpus;
+        console.log('\n' + corpus + ':');
+    }
+    var change = (r.ops / b.ops - 1) * 100;
+    console.log('  ' + pad(r.bench, 22) +
+                pad(b.ops.toFixed(1), 12, true) +
+                pad(r.ops.toFixed(1), 12, true) + ' ops/sec' +
+                pad((change >= 0 ? '+' : '') + change.toFixed(1) + '%', 10, true));
+});
@@ -0,0 +1,92 @@
+// Representative test corpora for the benchmarks.  They are generated
+// from a fixed seed, so every run (and every machine) sees the same text.
+
+var WORDS = {
+    latin: ('lorem ipsum dolor sit amet consectetur adipiscing elit sed do ' +
+            'eiusmod tempor incididunt ut labore et dolore magna aliqua')
+        .split(' '),
+    hebrew: ('בְּרֵאשִׁית בָּרָא אֱלֹהִים אֵת הַשָּׁמַיִם וְאֵת הָאָרֶץ ' +
+             'וְהָאָרֶץ הָיְתָה תֹהוּ וָבֹהוּ וְחֹשֶׁךְ עַל פְּנֵי תְהוֹם')
+        .split(' '),
+    arabic: ('في البدء خلق الله السماوات والأرض وكانت الأرض خربة ' +
+             'وخالية وعلى وجه الغمر ظلمة وروح الله يرف على وجه المياه')
+        .split(' ')
+};
+
+// A small deterministic PRNG (a linear congruential generator).
+var random = function(seed) {
+    return function() {
+        seed = (seed * 1103515245 + 12345) & 0x7FFFFFFF;
+        return seed / 0x80000000;
+    };
+};
+
+var pick = function(rand, list) {
+    return list[Math.floor(rand() * list.length)];
+};
+
+var number = function(rand) {
+    return pick(rand, ['', '$', '#', '-']) +
+        Math.floor(rand() * 100000) +
+        pick(rand, ['', '.5', ',000', '%']);
+};
+
+// Build a paragraph of about `length` characters; `next` picks each word.
+var paragraph = function(length, next) {
+    var words = [], n = 0;
+    while (n < length) {
+        var w = next();
+        words.push(w);
+        n += w.length + 1;
+    }
+    return words.join(' ');
+};
+
+var corpora = {
+    ltr: function(rand) {
+        return paragraph(4000, function() { return pick(rand, WORDS.latin); });
+    },
+    hebrew: function(rand) {
+        return paragraph(4000, function() { return pick(rand, WORDS.hebrew); });
+    },
+    arabic: function(rand) {
+        return paragraph(4000, function() { return pick(rand, WORDS.arabic); });
+    },
+    mixed: function(rand) {
+        var scripts = ['latin', 'hebrew', 'arabic'];
+        var script = 'latin';
+        return paragraph(4000, function() {
+            if (rand() < 0.2) { script = pick(rand, scripts); }
+            var w = pick(rand, WORDS[script]);
+            return rand() < 0.1 ? '(' + w + ')' : w;
+        });
+    },
+    numbers: function(rand) {
+        return paragraph(4000, function() {
+            return rand() < 0.5 ? number(rand) :
+                pick(rand, rand() < 0.5 ? WORDS.hebrew : WORDS.latin);
+        });
+    },
+    document: function(rand) {
+        // about 1MB of text in paragraphs of various lengths and scripts
+        var paras = [], n = 0;
+        while (n < 1024 * 1024) {
+            var list = WORDS[pick(rand, ['latin', 'hebrew', 'arabic'])];
+            var p = paragraph(50 + Math.floor(rand() * 1000), function() {
+                return rand() < 0.05 ? number(rand) : pick(rand, list);
+            });
+            paras.push(p);
+            n += p.length + 1;
+        }
+        return paras.join('\n');
+    }
+};
+
+// Return a map from corpus name to text.
+module.exports = function() {
+    var result = {};
+    Object.keys(corpora).forEach(function(name, i) {
+        result[name] = corpora[name](random(i + 1));
+    });
+    return result;
+};
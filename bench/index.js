@@ -0,0 +1,138 @@
+#!/usr/bin/env node
+// Measure the throughput of the main APIs over a set of corpora.
+//
+//   node bench [--json] [--time=SECONDS] [--filter=REGEXP] [CORPUS...]
+//
+// With --json the results are written to stdout as JSON, which
+// bench/compare.js can compare against another run.
+var ubidi = require('../');
+var corpora = require('./corpora')();
+
+var args = process.argv.slice(2);
+var json = false, time = 0.5, filter = null, only = [];
+args.forEach(function(arg) {
+    var m;
+    if (arg === '--json') { json = true; }
+    else if ((m = /^--time=(.*)$/.exec(arg))) { time = +m[1]; }
+    else if ((m = /^--filter=(.*)$/.exec(arg))) { filter = new RegExp(m[1]); }
+    else { only.push(arg); }
+});
+
+// Split text into lines of at most `width` characters, which don't cross
+// paragraph boundaries.  Returns the offsets at which lines start.
+var lineBreaks = function(text, width) {
+    var breaks = [], start = 0;
+    for (var i = 0; i < text.length; i++) {
+        if (text[i] === '\n' || i + 1 - start === width) {
+            if (i + 1 < text.length) { breaks.push(i + 1); }
+            start = i + 1;
+        }
+    }
+    return new Int32Array(breaks);
+};
+
+var benchmarks = {
+    'new Paragraph': function(c) { return new ubidi.Paragraph(c.text); },
+    'reset': function(c) { return c.p.reset(c.text); },
+    'writeReordered': function(c) { return c.p.writeReordered(); },
+    'writeReorderedInto': function(c) {
+        return c.p.writeReorderedInto(c.u16);
+    },
+    'setLine loop': function(c) {
+        var s = 0, r;
+        for (var i = 0; i <= c.breaks.length; i++) {
+            var limit = i < c.breaks.length ? c.breaks[i] : c.text.length;
+            r = c.p.setLine(s, limit).writeReordered();
+            s = limit;
+        }
+        return r;
+    },
+    'layoutLines': function(c) { return c.p.layoutLines(c.breaks); },
+    'getLevelAt loop': function(c) {
+        var sum = 0;
+        for (var i = 0; i < c.length; i++) { sum += c.p.getLevelAt(i); }
+        return sum;
+    },
+    'getLevels': function(c) { return c.p.getLevels(c.levels); },
+    'getVisualIndex loop': function(c) {
+        var sum = 0;
+        for (var i = 0; i < c.length; i++) { sum += c.p.getVisualIndex(i); }
+        return sum;
+    },
+    'getVisualMap': function(c) { return c.p.getVisualMap(c.map); },
+    'getVisualRun loop': function(c) {
+        var n = c.p.countRuns(), r;
+        for (var i = 0; i < n; i++) { r = c.p.getVisualRun(i); }
+        return r;
+    },
+    'getRuns': function(c) { return c.p.getRuns(); }
+};
+
+// Run fn for at least `time` seconds; return the number of calls per second.
+var measure = function(fn, context) {
+    var count = 0, batch = 1, elapsed = 0, start = process.hrtime();
+    fn(context); // warm up
+    var d = process.hrtime(start);
+    if (d[0] + d[1] / 1e9 > time) {
+        // slow enough that the warm up will have to do
+        return 1 / (d[0] + d[1] / 1e9);
+    }
+    start = process.hrtime();
+    while (elapsed < time) {
+        for (var i = 0; i < batch; i++) { fn(context); }
+        count += batch;
+        batch *= 2;
+        d = process.hrtime(start);
+        elapsed = d[0] + d[1] / 1e9;
+    }
+    return count / elapsed;
+};
+
+var pad = function(s, n, left) {
+    s = String(s);
+    while (s.length < n) { s = left ? ' ' + s : s + ' '; }
+    return s;
+};
+
+var results = {
+    node: process.version,
+    icu: ubidi.ICU_VERSION,
+    results: []
+};
+if (!json) {
+    console.log('node ' + results.node + ', ICU ' + results.icu);
+}
+Object.keys(corpora).forEach(function(name) {
+    if (only.length && only.indexOf(name) < 0) { return; }
+    var text = corpora[name];
+    var bytes = Buffer.byteLength(text);
+    var context = {
+        text: text,
+        length: text.length,
+        p: new ubidi.Paragraph(text),
+        breaks: lineBreaks(text, 80),
+        u16: new Uint16Array(text.length),
+        levels: new Uint8Array(text.length),
+        map: new Int32Array(text.length)
+    };
+    if (!json) {
+        console.log('\n' + name + ': ' + text.length + ' chars, ' +
+                    bytes + ' bytes UTF-8');
+    }
+    Object.keys(benchmarks).forEach(function(bench) {
+        if (filter && !filter.test(bench)) { return; }
+        var ops = measure(benchmarks[bench], context);
+        var mbs = ops * bytes / (1024 * 1024);
+        results.results.push({
+            corpus: name, bench: bench, ops: ops, mbs: mbs
+        });
+        if (!json) {
+            console.log('  ' + pad(bench, 22) +
+                        pad(ops.toFixed(1), 12, true) + ' ops/sec' +
+                        pad(mbs.toFixed(2), 10, true) + ' MB/s');
+        }
+    });
+});
+if (json) {
+    console.log(JSON.stringify(results, null, 2));
+}
@@ -0,0 +1,86 @@
+#!/usr/bin/env node
+// Measure the size of the built addon and how long it takes to load.
+//
+//   node bench/size.js [--runs=N] [--check-icu]
+//
+// Each load is timed in a fresh node process, so that nothing is cached
+// by the module system.  Build with `--libicu=slim`, `internal` or
+// `external` and run this again to compare.
+//
+// The ICU symbols the addon leaves undefined are listed too.  A shared
+// object may be linked with undefined symbols, so a slim build which
+// calls something outside ICU's common library still links, and only
+// fails at run time; `--check-icu` exits with an error if there are any.
+var childProcess = require('child_process');
+var fs = require('fs');
+var path = require('path');
+var binary = require('node-pre-gyp');
+
+var runs = 20, checkIcu = false;
+process.argv.slice(2).forEach(function(arg) {
+    var m = /^--runs=(\d+)$/.exec(arg);
+    if (m) { runs = +m[1]; }
+    if (arg === '--check-icu') { checkIcu = true; }
+});
+
+var root = path.resolve(__dirname, '..');
+var bindingPath = binary.find(path.join(root, 'package.json'));
+
+// Time require() of `target` in a new process, in milliseconds.
+var timeRequire = function(target) {
+    var script = [
+        "var start = process.hrtime();",
+        "require(" + JSON.stringify(target) + ");",
+        "var t = process.hrtime(start);",
+        "console.log(t[0] * 1e3 + t[1] / 1e6);"
+    ].join('\n');
+    return +childProcess.execFileSync(process.execPath, ['-e', script], {
+        encoding: 'utf8'
+    });
+};
+
+// The undefined symbols of `target` which belong to ICU: C functions
+// carry its version suffix (ubidi_open_55), and C++ lives in the icu_55
+// namespace.  Returns null if `nm` isn't available.
+var undefinedIcuSymbols = function(target) {
+    var output;
+    try {
+        output = childProcess.execFileSync('nm', ['-u', target], {
+            encoding: 'utf8', stdio: ['ignore', 'pipe', 'ignore']
+        });
+    } catch (e) {
+        return null;
+    }
+    return output.split('\n').map(function(line) {
+        return line.trim().split(/\s+/).pop();
+    }).filter(function(name) {
+        return /^_?u[a-z]*_\w+_\d+$/.test(name) || /icu_\d+/.test(name);
+    });
+};
+
+var median = function(values) {
+    values = values.slice().sort(function(a, b) { return a - b; });
+    var mid = values.length >> 1;
+    return values.length % 2 ? values[mid] :
+        (values[mid - 1] + values[mid]) / 2;
+};
+
+var measure = function(target) {
+    var times = [];
+    for (var i = 0; i < runs; i++) { times.push(timeRequire(target)); }
+    return median(times).toFixed(2) + ' ms';
+};
+
+console.log('addon:          ' + path.relative(root, bindingPath));
+console.log('size:           ' + fs.statSync(bindingPath).size + ' bytes');
+console.log('require addon:  ' + measure(bindingPath) +
+            ' (median of ' + runs + ')');
+console.log('require module: ' + measure(root));
+var symbols = undefinedIcuSymbols(bindingPath);
+console.log('undefined ICU:  ' + (symbols === null ? 'n/a (no nm)' :
+                                  symbols.length ? symbols.join(' ') :
+                                  'none'));
+if (checkIcu && (symbols === null || symbols.length > 0)) {
+    console.error('The addon must not need any ICU symbols at load time');
+    process.exit(1);
+}
@@ -8,19 +8,26 @@
       'target_name': 'icu_bidi',
       "include_dirs": ["<!(node -e \"require('nan')\")"],
       'conditions': [
-        ['libicu != "internal"', {
-            'libraries': [ "<!@(icu-config --ldflags)" ],
-            'cflags': [ "<!@(icu-config --cppflags)" ]
-        },
-        {
+        ['libicu == "internal"', {
             'dependencies': [
               'deps/libicu.gyp:libicu'
             ]
-        }
-        ]
+        }],
+        ['libicu == "slim"', {
+            'dependencies': [
+              'deps/libicu.gyp:libicu_slim'
+            ]
+        }],
+        ['libicu != "internal" and libicu != "slim"', {
+            'libraries': [ "<!@(icu-config --ldflags)" ],
+            'cflags': [ "<!@(icu-config --cppflags)" ]
+        }]
       ],
       'sources': [
         'src/node_icu_bidi.cc',
+        'src/batch.cc',
+        'src/prescan.cc',
+        'src/cache.cc',
       ],
     },
     {
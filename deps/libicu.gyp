@@ -105,6 +105,47 @@
         }
       ]
     },
+    {
+      # Only the common library, which has everything the addon uses
+      # (bidi, shaping and their property data are compiled into it).
+      # Skips i18n, the tools and the data library, which the addon
+      # never links against anyway.
+      'target_name': 'build_slim',
+      'dependencies': [
+        'action_before_build'
+      ],
+      'actions': [
+        {
+          'action_name': 'build_libicu_slim',
+          'inputs': [
+            '<(SHARED_INTERMEDIATE_DIR)/icu/source/Makefile'
+          ],
+          'outputs': [
+            '<(SHARED_INTERMEDIATE_DIR)/icu/source/lib/libicuuc.a'
+          ],
+          'action': ['make', '-C', '<(SHARED_INTERMEDIATE_DIR)/icu/source/',
+                     '-j', '2', 'SUBDIRS=stubdata common']
+        }
+      ]
+    },
+    {
+      'target_name': 'libicu_slim',
+      'type': 'none',
+      'dependencies': [
+        'build_slim'
+      ],
+      'direct_dependent_settings': {
+        'include_dirs': [ '<(SHARED_INTERMEDIATE_DIR)/icu/source/common/' ],
+      },
+      'link_settings': {
+        'libraries': [
+            '<(SHARED_INTERMEDIATE_DIR)/icu/source/lib/libicuuc.a',
+        ]
+      },
+      'sources': [
+            '<(SHARED_INTERMEDIATE_DIR)/icu/source/lib/libicuuc.a',
+      ]
+    },
     {
       'target_name': 'libicu',
       'type': 'none',
@@ -0,0 +1,184 @@
+// Resolve large documents in parallel, by splitting them at paragraph
+// boundaries and running the bidi algorithm on each piece on the libuv
+// threadpool.
+
+// Don't bother splitting documents into pieces smaller than this.
+var MIN_PIECE_LENGTH = 65536;
+
+// Paragraph separators (bidi class B).
+var SEPARATOR = /[\n\r\x1c-\x1e\x85\u2029]/g;
+
+// Return the offsets at which to split `text` into about `count` pieces.
+var splitDocument = function(bindings, text, count) {
+    var size = Math.max(MIN_PIECE_LENGTH, Math.ceil(text.length / count));
+    var starts = [0], start = 0, from = size;
+    while (text.length - start > size) {
+        SEPARATOR.lastIndex = from;
+        var m = SEPARATOR.exec(text);
+        if (!m) { break; }
+        var next = m.index + 1;
+        // CR LF is a single separator.
+        if (m[0] === '\r' && text.charCodeAt(next) === 0x0A) { next++; }
+        if (next >= text.length) { break; }
+        from = next;
+        // With a default paragraph level ICU lets the last strong
+        // character of one paragraph affect numbers at the start of the
+        // next, so only split before a paragraph which starts with a
+        // strong character.
+        var c = text.charCodeAt(next);
+        var first = text.slice(next, c >= 0xD800 && c <= 0xDBFF ?
+                               next + 2 : next + 1);
+        if (bindings.getBaseDirection(first) === 'neutral') { continue; }
+        starts.push(start = next);
+        from = start + size;
+    }
+    return starts;
+};
+
+var dir2str = function(level) { return (level & 1) ? 'rtl' : 'ltr'; };
+
+// The merged results for a whole document, with (a subset of) the same
+// methods as a Paragraph.
+function Document(length, starts, results) {
+    var i, j;
+    this._length = length;
+    this._processedLength = this._resultLength = 0;
+    this._levels = new Uint8Array(length);
+    this._text = results.map(function(r) { return r.reordered; }).join('');
+    this._paraLevel = results[0].paraLevel;
+    this._dir = results[0].dir;
+    var runs = [], paragraphs = [];
+    for (i = 0; i < results.length; i++) {
+        var offset = starts[i], r = results[i];
+        this._levels.set(r.levels, offset);
+        this._processedLength += r.processedLength;
+        this._resultLength += r.resultLength;
+        if (r.dir !== this._dir) { this._dir = 'mixed'; }
+        for (j = 0; j < r.runs.length; j += 3) {
+            var n = runs.length;
+            // Runs on either side of a split may belong together, if
+            // they are contiguous.
+            if (j === 0 && n > 0 && r.runs[0] === 0 &&
+                runs[n - 3] + runs[n - 2] === offset &&
+                runs[n - 1] === r.runs[2]) {
+                runs[n - 2] += r.runs[1];
+                continue;
+            }
+            runs.push(offset + r.runs[j], r.runs[j + 1], r.runs[j + 2]);
+        }
+        for (j = 0; j < r.paragraphs.length; j += 3) {
+            paragraphs.push(offset + r.paragraphs[j],
+                            offset + r.paragraphs[j + 1],
+                            r.paragraphs[j + 2]);
+        }
+    }
+    this._runs = new Int32Array(runs);
+    this._paragraphs = new Int32Array(paragraphs);
+}
+
+Document.prototype.getLength = function() { return this._length; };
+Document.prototype.getProcessedLength = function() {
+    return this._processedLength;
+};
+Document.prototype.getResultLength = function() {
+    return this._resultLength;
+};
+Document.prototype.getParaLevel = function() { return this._paraLevel; };
+Document.prototype.getDirection = function() { return this._dir; };
+Document.prototype.getLevelAt = function(charIndex) {
+    return this._levels[charIndex] || 0;
+};
+Document.prototype.getLevels = function() {
+    return new Uint8Array(this._levels);
+};
+Document.prototype.countRuns = function() { return this._runs.length / 3; };
+Document.prototype.getRuns = function() {
+    return new Int32Array(this._runs);
+};
+Document.prototype.getVisualRun = function(runIndex) {
+    if (!(runIndex >= 0 && runIndex < this.countRuns())) {
+        throw new TypeError('Run index out of bounds');
+    }
+    return {
+        dir: dir2str(this._runs[3 * runIndex + 2]),
+        logicalStart: this._runs[3 * runIndex],
+        length: this._runs[3 * runIndex + 1]
+    };
+};
+Document.prototype.countParagraphs = function() {
+    return this._paragraphs.length / 3;
+};
+Document.prototype.getParagraphByIndex = function(paraIndex) {
+    if (!(paraIndex >= 0 && paraIndex < this.countParagraphs())) {
+        throw new Error('Paragraph index out of bounds');
+    }
+    var p = this._paragraphs, level = p[3 * paraIndex + 2];
+    return {
+        index: paraIndex,
+        start: p[3 * paraIndex],
+        limit: p[3 * paraIndex + 1],
+        level: level,
+        dir: dir2str(level)
+    };
+};
+Document.prototype.getParagraph = function(charIndex) {
+    if (!(charIndex >= 0 && charIndex < this._length)) {
+        throw new Error('Character index out of bounds');
+    }
+    // binary search for the paragraph containing charIndex
+    var lo = 0, hi = this.countParagraphs() - 1;
+    while (lo < hi) {
+        var mid = (lo + hi + 1) >>> 1;
+        if (this._paragraphs[3 * mid] <= charIndex) { lo = mid; }
+        else { hi = mid - 1; }
+    }
+    return this.getParagraphByIndex(lo);
+};
+// The text was reordered with `options.writeOptions`.
+Document.prototype.writeReordered = function() { return this._text; };
+
+// Resolve `text` in pieces on the threadpool, and call back with a merged
+// Document.
+var processDocument = function(bindings, text, options, callback) {
+    if (typeof text !== 'string') {
+        text = Buffer.isBuffer(text) ? text.toString(options.encoding) :
+            String(text);
+    }
+    // Paragraphs are resolved separately, so they can't be reordered
+    // with respect to each other.
+    if (options.reorderParagraphsLTR === false) {
+        throw new TypeError(
+            'Documents are always resolved with reorderParagraphsLTR'
+        );
+    }
+    var concurrency = options.concurrency ||
+        +process.env.UV_THREADPOOL_SIZE || 4;
+    var starts = splitDocument(bindings, text, concurrency);
+    var results = new Array(starts.length), pending = starts.length;
+    var failed = false;
+    var done = function(i, err, result) {
+        if (failed) { return; }
+        if (err) { failed = true; return callback(err); }
+        results[i] = result[0];
+        if (--pending === 0) {
+            callback(null, new Document(text.length, starts, results));
+        }
+    };
+    for (var i = 0; i < starts.length; i++) {
+        var pieceOptions = {};
+        for (var k in options) { pieceOptions[k] = options[k]; }
+        pieceOptions.levels = pieceOptions.runs =
+            pieceOptions.paragraphs = true;
+        pieceOptions.reorderParagraphsLTR = true;
+        // The context only applies at the ends of the document.
+        if (i > 0) { delete pieceOptions.prologue; }
+        if (i < starts.length - 1) { delete pieceOptions.epilogue; }
+        bindings.processBatch(
+            [text.slice(starts[i], starts[i + 1])],
+            pieceOptions, done.bind(null, i)
+        );
+    }
+};
+
+exports.Document = Document;
+exports.processDocument = processDocument;
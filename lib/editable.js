@@ -0,0 +1,292 @@
+// Text which can be edited in place.  The text is split into pieces of
+// one or more paragraphs (each up to and including its separator), and
+// each piece is resolved by a Paragraph of its own, so an edit only has
+// to resolve the pieces it touches again.
+
+// Paragraph separators (bidi class B).
+var SEPARATOR = /[\n\r\x1c-\x1e\x85\u2029]/g;
+
+// With a default paragraph level ICU lets the last strong character of
+// one paragraph affect numbers at the start of the next, so (as in
+// lib/document.js) a piece may only start with a strong character.
+var startsPiece = function(bindings, text, index) {
+    var c = text.charCodeAt(index);
+    var first = text.slice(index, c >= 0xD800 && c <= 0xDBFF ?
+                           index + 2 : index + 1);
+    return bindings.getBaseDirection(first) !== 'neutral';
+};
+
+// Split `text` into pieces, each ending with a separator (if any).
+var splitPieces = function(bindings, text) {
+    var pieces = [], start = 0, m;
+    SEPARATOR.lastIndex = 0;
+    while ((m = SEPARATOR.exec(text))) {
+        var next = m.index + 1;
+        // CR LF is a single separator.
+        if (m[0] === '\r' && text.charCodeAt(next) === 0x0A) {
+            next++;
+            SEPARATOR.lastIndex = next;
+        }
+        if (next < text.length && !startsPiece(bindings, text, next)) {
+            continue;
+        }
+        pieces.push(text.slice(start, next));
+        start = next;
+    }
+    if (start < text.length || pieces.length === 0) {
+        pieces.push(text.slice(start));
+    }
+    return pieces;
+};
+
+var dir2str = function(level) { return (level & 1) ? 'rtl' : 'ltr'; };
+
+function EditableParagraph(bindings, text, options) {
+    options = options || {};
+    if (typeof text !== 'string') {
+        text = Buffer.isBuffer(text) ? text.toString(options.encoding) :
+            String(text);
+    }
+    this._bindings = bindings;
+    this._prologue = options.prologue;
+    this._epilogue = options.epilogue;
+    // Options for each paragraph; the context only applies at the ends.
+    this._options = {};
+    var self = this;
+    ['paraLevel', 'reorderingMode', 'reorderingOptions', 'inverse',
+     'reorderParagraphsLTR']
+    .forEach(function(k) {
+        if (options[k] !== undefined) { self._options[k] = options[k]; }
+    });
+    // Paragraphs are resolved separately, so they can't be reordered
+    // with respect to each other.
+    if (this._options.reorderParagraphsLTR === false) {
+        throw new TypeError(
+            'Editable paragraphs are always resolved with reorderParagraphsLTR'
+        );
+    }
+    this._options.reorderParagraphsLTR = true;
+    this._texts = [];
+    this._starts = [];
+    this._paras = [];
+    this._length = 0;
+    // Tables for the whole text, built when they're first needed.
+    this._levels = this._runs = this._paragraphs = null;
+    this._replace(0, 0, splitPieces(bindings, text));
+}
+
+// The options for the piece which will be at `index` of `count`.
+EditableParagraph.prototype._paraOptions = function(index, count) {
+    var options = {};
+    for (var k in this._options) { options[k] = this._options[k]; }
+    if (index === 0 && this._prologue !== undefined) {
+        options.prologue = this._prologue;
+    }
+    if (index === count - 1 && this._epilogue !== undefined) {
+        options.epilogue = this._epilogue;
+    }
+    return options;
+};
+
+// Replace pieces [first, last) with new ones for `texts`, reusing the
+// old Paragraph objects where we can.
+EditableParagraph.prototype._replace = function(first, last, texts) {
+    this._levels = this._runs = this._paragraphs = null;
+    var count = this._texts.length - (last - first) + texts.length;
+    var paras = new Array(texts.length), starts = new Array(texts.length);
+    var offset = first > 0 ? this._starts[first] : 0, i;
+    for (i = 0; i < texts.length; i++) {
+        var options = this._paraOptions(first + i, count);
+        if (first + i < last) {
+            paras[i] = this._paras[first + i].reset(texts[i], options);
+        } else {
+            paras[i] = new this._bindings.Paragraph(texts[i], options);
+        }
+        starts[i] = offset;
+        offset += texts[i].length;
+    }
+    for (i = first + texts.length; i < last; i++) { this._paras[i].close(); }
+    var delta = offset - (last < this._starts.length ?
+                          this._starts[last] : this._length);
+    for (i = last; i < this._starts.length; i++) { this._starts[i] += delta; }
+    this._length += delta;
+    var splice = Array.prototype.splice;
+    splice.apply(this._texts, [first, last - first].concat(texts));
+    splice.apply(this._starts, [first, last - first].concat(starts));
+    splice.apply(this._paras, [first, last - first].concat(paras));
+    // Removing the first or last piece moves the context to the piece
+    // which takes its place.
+    if (texts.length === 0) {
+        var n = this._paras.length;
+        if (first === 0 && this._prologue !== undefined) {
+            this._paras[0].reset(this._texts[0], this._paraOptions(0, n));
+        }
+        if (first === n && this._epilogue !== undefined) {
+            this._paras[n - 1].reset(this._texts[n - 1],
+                                     this._paraOptions(n - 1, n));
+        }
+    }
+};
+
+// The index of the piece containing `charIndex` (or the last one).
+EditableParagraph.prototype._find = function(charIndex) {
+    var lo = 0, hi = this._starts.length - 1;
+    while (lo < hi) {
+        var mid = (lo + hi + 1) >>> 1;
+        if (this._starts[mid] <= charIndex) { lo = mid; }
+        else { hi = mid - 1; }
+    }
+    return lo;
+};
+
+// Delete `deleteCount` characters at `start`, and insert `insertText`
+// there.  Only the pieces affected are resolved again.
+EditableParagraph.prototype.edit = function(start, deleteCount, insertText) {
+    insertText = insertText === undefined ? '' : String(insertText);
+    if (!(start >= 0 && deleteCount >= 0 &&
+          start + deleteCount <= this._length)) {
+        throw new RangeError('Edit must be within the text');
+    }
+    var first = this._find(start);
+    // Deleting a separator joins a paragraph to the next.
+    var last = this._find(start + deleteCount) + 1;
+    var offset = this._starts[first];
+    var text = this._texts.slice(first, last).join('');
+    text = text.slice(0, start - offset) + insertText +
+        text.slice(start + deleteCount - offset);
+    // A piece which no longer starts with a strong character (including
+    // an LF which joins the previous piece's CR) joins the one before.
+    if (first > 0 && start === offset && text !== '' &&
+        !startsPiece(this._bindings, text, 0)) {
+        first--;
+        text = this._texts[first] + text;
+    }
+    // Keep a single (empty) paragraph for empty text.
+    var texts = text === '' && this._texts.length > last - first ?
+        [] : splitPieces(this._bindings, text);
+    this._replace(first, last, texts);
+    return this;
+};
+
+EditableParagraph.prototype.getText = function() {
+    return this._texts.join('');
+};
+EditableParagraph.prototype.getLength =
+EditableParagraph.prototype.getProcessedLength =
+EditableParagraph.prototype.getResultLength = function() {
+    return this._length;
+};
+EditableParagraph.prototype.getParaLevel = function() {
+    return this._paras[0].getParaLevel();
+};
+EditableParagraph.prototype.getDirection = function() {
+    var dir = this._paras[0].getDirection();
+    for (var i = 1; i < this._paras.length; i++) {
+        if (this._paras[i].getDirection() !== dir) { return 'mixed'; }
+    }
+    return dir;
+};
+EditableParagraph.prototype.getLevelAt = function(charIndex) {
+    var i = this._find(charIndex);
+    return this._paras[i].getLevelAt(charIndex - this._starts[i]);
+};
+EditableParagraph.prototype.getLevels = function() {
+    if (!this._levels) {
+        this._levels = new Uint8Array(this._length);
+        for (var i = 0; i < this._paras.length; i++) {
+            this._levels.set(this._paras[i].getLevels(), this._starts[i]);
+        }
+    }
+    return new Uint8Array(this._levels);
+};
+EditableParagraph.prototype._getRuns = function() {
+    if (this._runs) { return this._runs; }
+    var runs = [];
+    for (var i = 0; i < this._paras.length; i++) {
+        var offset = this._starts[i], r = this._paras[i].getRuns();
+        for (var j = 0; j < r.length; j += 3) {
+            var n = runs.length;
+            // Runs on either side of a piece boundary may belong
+            // together, if they are contiguous.
+            if (j === 0 && n > 0 &&
+                runs[n - 3] + runs[n - 2] === offset + r[0] &&
+                runs[n - 1] === r[2]) {
+                runs[n - 2] += r[1];
+                continue;
+            }
+            runs.push(offset + r[j], r[j + 1], r[j + 2]);
+        }
+    }
+    return (this._runs = new Int32Array(runs));
+};
+EditableParagraph.prototype.countRuns = function() {
+    return this._getRuns().length / 3;
+};
+EditableParagraph.prototype.getRuns = function() {
+    return new Int32Array(this._getRuns());
+};
+EditableParagraph.prototype.getVisualRun = function(runIndex) {
+    var runs = this._getRuns();
+    if (!(runIndex >= 0 && runIndex < runs.length / 3)) {
+        throw new TypeError('Run index out of bounds');
+    }
+    return {
+        dir: dir2str(runs[3 * runIndex + 2]),
+        logicalStart: runs[3 * runIndex],
+        length: runs[3 * runIndex + 1]
+    };
+};
+// The start, limit and level of each paragraph, from every piece.
+EditableParagraph.prototype._getParagraphs = function() {
+    if (this._paragraphs) { return this._paragraphs; }
+    var paragraphs = [];
+    for (var i = 0; i < this._paras.length; i++) {
+        var offset = this._starts[i], p = this._paras[i];
+        var count = p.countParagraphs();
+        for (var j = 0; j < count; j++) {
+            var q = p.getParagraphByIndex(j);
+            paragraphs.push(offset + q.start, offset + q.limit, q.level);
+        }
+    }
+    return (this._paragraphs = new Int32Array(paragraphs));
+};
+EditableParagraph.prototype.countParagraphs = function() {
+    return this._getParagraphs().length / 3;
+};
+EditableParagraph.prototype.getParagraphByIndex = function(paraIndex) {
+    if (!(paraIndex >= 0 && paraIndex < this.countParagraphs())) {
+        throw new Error('Paragraph index out of bounds');
+    }
+    var p = this._getParagraphs(), level = p[3 * paraIndex + 2];
+    return {
+        index: paraIndex,
+        start: p[3 * paraIndex],
+        limit: p[3 * paraIndex + 1],
+        level: level,
+        dir: dir2str(level)
+    };
+};
+EditableParagraph.prototype.getParagraph = function(charIndex) {
+    if (!(charIndex >= 0 && charIndex < this._length)) {
+        throw new Error('Character index out of bounds');
+    }
+    // binary search for the paragraph containing charIndex
+    var p = this._getParagraphs(), lo = 0, hi = p.length / 3 - 1;
+    while (lo < hi) {
+        var mid = (lo + hi + 1) >>> 1;
+        if (p[3 * mid] <= charIndex) { lo = mid; }
+        else { hi = mid - 1; }
+    }
+    return this.getParagraphByIndex(lo);
+};
+EditableParagraph.prototype.writeReordered = function(options) {
+    options = options || 0;
+    return this._paras.map(function(p) {
+        return p.writeReordered(options);
+    }).join('');
+};
+EditableParagraph.prototype.close = function() {
+    this._paras.forEach(function(p) { p.close(); });
+};
+
+module.exports = EditableParagraph;
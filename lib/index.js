@@ -1,5 +1,8 @@
 var binary = require('node-pre-gyp');
 var path = require('path');
+var ReorderStream = require('./stream');
+var document = require('./document');
+var EditableParagraph = require('./editable');
 var binding_path =
   binary.find(path.resolve(path.join(__dirname, '..', 'package.json')));
 var bindings = require(binding_path);
@@ -7,3 +10,76 @@ var bindings = require(binding_path);
 Object.keys(bindings).forEach(function(k) {
     exports[k] = bindings[k];
 });
+
+// Don't bother splitting batches smaller than this across threads.
+var MIN_CHUNK_SIZE = 64;
+
+// Run the bidi algorithm over an array of strings on the libuv threadpool.
+// Returns a Promise unless a node-style callback is given.
+exports.processBatch = function(texts, options, callback) {
+    if (typeof options === 'function') {
+        callback = options;
+        options = undefined;
+    }
+    options = options || {};
+    if (!callback) {
+        return new Promise(function(resolve, reject) {
+            exports.processBatch(texts, options, function(err, results) {
+                if (err) { reject(err); } else { resolve(results); }
+            });
+        });
+    }
+    // Split large batches into chunks which can run in parallel.
+    var concurrency = options.concurrency ||
+        +process.env.UV_THREADPOOL_SIZE || 4;
+    var chunks = Math.max(1, Math.min(
+        concurrency, Math.floor(texts.length / MIN_CHUNK_SIZE)
+    ));
+    var chunkSize = Math.ceil(texts.length / chunks);
+    var results = new Array(chunks), pending = chunks, failed = false;
+    var done = function(i, err, chunk) {
+        if (failed) { return; }
+        if (err) { failed = true; return callback(err); }
+        results[i] = chunk;
+        if (--pending === 0) {
+            callback(null, Array.prototype.concat.apply([], results));
+        }
+    };
+    for (var i = 0; i < chunks; i++) {
+        bindings.processBatch(
+            chunks === 1 ? texts :
+                texts.slice(i * chunkSize, (i + 1) * chunkSize),
+            options, done.bind(null, i)
+        );
+    }
+};
+
+// Create a Transform stream which reorders the text written to it, one
+// paragraph at a time.
+exports.createReorderStream = function(options) {
+    return new ReorderStream(bindings, options);
+};
+
+// Resolve a large document in parallel, one group of paragraphs per
+// thread.  Returns a Promise unless a node-style callback is given.
+exports.processDocument = function(text, options, callback) {
+    if (typeof options === 'function') {
+        callback = options;
+        options = undefined;
+    }
+    options = options || {};
+    if (!callback) {
+        return new Promise(function(resolve, reject) {
+            exports.processDocument(text, options, function(err, result) {
+                if (err) { reject(err); } else { resolve(result); }
+            });
+        });
+    }
+    document.processDocument(bindings, text, options, callback);
+};
+
+// Create an editable paragraph, which only resolves the paragraphs
+// touched by each edit again.  Like Paragraph, works with or without `new`.
+exports.EditableParagraph = function(text, options) {
+    return new EditableParagraph(bindings, text, options);
+};
@@ -0,0 +1,107 @@
+var StringDecoder = require('string_decoder').StringDecoder;
+var Transform = require('stream').Transform;
+var util = require('util');
+
+// Without a paragraph separator we have to break the text somewhere.
+var DEFAULT_MAX_PARAGRAPH_LENGTH = 65536;
+
+// A Transform stream which reorders text as it flows through, one
+// paragraph at a time.  Input may be strings or Buffers (decoded with
+// `options.encoding`); output is UTF-8 Buffers.
+function ReorderStream(bindings, options) {
+    Transform.call(this, { decodeStrings: false });
+    options = options || {};
+    this._bindings = bindings;
+    this._decoder = new StringDecoder(options.encoding || 'utf8');
+    this._writeOptions = options.writeOptions || 0;
+    this._maxParagraphLength =
+        options.maxParagraphLength || DEFAULT_MAX_PARAGRAPH_LENGTH;
+    this._prologue = options.prologue;
+    this._epilogue = options.epilogue;
+    // Options for each setPara; the context only applies at the ends.
+    this._options = {};
+    var self = this;
+    ['paraLevel', 'reorderingMode', 'inverse', 'reorderParagraphsLTR']
+    .forEach(function(k) {
+        if (options[k] !== undefined) { self._options[k] = options[k]; }
+    });
+    // Paragraphs are written out as they arrive, so they can't be
+    // reordered with respect to each other.
+    if (this._options.reorderParagraphsLTR === undefined) {
+        this._options.reorderParagraphsLTR = true;
+    }
+    this._reorderingOptions = options.reorderingOptions || 0;
+    this._para = null;
+    this._tail = '';
+    this._ending = false;
+}
+util.inherits(ReorderStream, Transform);
+
+ReorderStream.prototype._setPara = function(text, streaming) {
+    var options = {};
+    for (var k in this._options) { options[k] = this._options[k]; }
+    options.reorderingOptions = this._reorderingOptions |
+        (streaming ? this._bindings.ReorderingOption.STREAMING : 0);
+    // The prologue stays until the text after it has been written out.
+    if (this._prologue !== undefined) {
+        options.prologue = this._prologue;
+    }
+    if (this._ending && this._epilogue !== undefined) {
+        options.epilogue = this._epilogue;
+    }
+    if (this._para) {
+        this._para.reset(text, options);
+    } else {
+        this._para = new this._bindings.Paragraph(text, options);
+    }
+    return this._para;
+};
+
+// Write out the reordered text of `p`.
+ReorderStream.prototype._pushPara = function(p) {
+    this.push(p.writeReorderedUtf8(this._writeOptions));
+    this._prologue = undefined;
+};
+
+ReorderStream.prototype._transform = function(chunk, encoding, callback) {
+    var text = this._tail + (typeof chunk === 'string' ? chunk :
+                             this._decoder.write(chunk));
+    try {
+        // ICU stops at the last paragraph separator and tells us how far
+        // it got; the rest is carried over into the next chunk.
+        var p = this._setPara(text, true);
+        var processed = p.getProcessedLength();
+        if (processed > 0) {
+            this._pushPara(p);
+        }
+        this._tail = text.slice(processed);
+        while (this._tail.length > this._maxParagraphLength) {
+            // Don't split a surrogate pair.
+            var n = this._maxParagraphLength;
+            var c = this._tail.charCodeAt(n - 1);
+            if (c >= 0xD800 && c <= 0xDBFF) { n--; }
+            this._pushPara(this._setPara(this._tail.slice(0, n), false));
+            this._tail = this._tail.slice(n);
+        }
+    } catch (e) {
+        return callback(e);
+    }
+    callback();
+};
+
+ReorderStream.prototype._flush = function(callback) {
+    var text = this._tail + this._decoder.end();
+    this._tail = '';
+    this._ending = true;
+    try {
+        if (text.length > 0) {
+            this._pushPara(this._setPara(text, false));
+        }
+        if (this._para) { this._para.close(); }
+    } catch (e) {
+        return callback(e);
+    }
+    callback();
+};
+
+module.exports = ReorderStream;
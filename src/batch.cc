@@ -0,0 +1,343 @@
+#include <node.h>
+#include <v8.h>
+#include <cstring> // for std::memcpy
+#include <vector>
+
+#include "unicode/ubidi.h"
+
+#include "nan.h"
+#include "macros.h"
+#include "bidi.h"
+
+using namespace v8;
+
+/* Runs the bidi algorithm over a batch of strings on the libuv
+ * threadpool.  All text is copied out of V8 up front, and all results
+ * are converted back to JavaScript values once the work is done. */
+class BatchWorker : public Nan::AsyncWorker {
+public:
+  BatchWorker(Nan::Callback *callback, BidiAddon *addon,
+              const BidiOptions &options, uint16_t writeOptions,
+              bool wantLevels, bool wantRuns, bool wantParagraphs)
+    : Nan::AsyncWorker(callback),
+      addon(addon),
+      opts(options),
+      writeOptions(writeOptions),
+      wantLevels(wantLevels),
+      wantRuns(wantRuns),
+      wantParagraphs(wantParagraphs),
+      // Mirroring and combining marks only matter in RTL runs.
+      defaultLTR(bidi_IsDefaultLTR(options) && 0 == (writeOptions &
+        ~(UBIDI_DO_MIRRORING | UBIDI_KEEP_BASE_COMBINING))),
+      maxLength(0),
+      errorCode(U_ZERO_ERROR),
+      stats() {
+    // The option text is only valid in the current handle scope,
+    // so copy it out now.
+    Copy(options.prologue, &prologue);
+    Copy(options.epilogue, &epilogue);
+    opts.prologue.value.Clear();
+    opts.epilogue.value.Clear();
+    // Explicit levels belong to a single text; they don't apply here.
+    opts.embeddingLevels = NULL;
+    bidi_AddonRef(addon);
+  }
+  ~BatchWorker() {
+    bidi_AddonUnref(addon);
+  }
+
+  void AddText(const BidiInput &input) {
+    Item item;
+    item.start = text.size();
+    item.length = Copy(input, &text);
+    if (item.length > maxLength) {
+      maxLength = item.length;
+    }
+    items.push_back(item);
+  }
+
+  void Execute() {
+    BidiTraceScope trace("processBatch (worker)");
+    UBiDi *para = ubidi_openSized(maxLength, 0, &errorCode);
+    if (U_FAILURE(errorCode)) {
+      SetErrorMessage("libicu open failed");
+      return;
+    }
+    bidi_ApplyOptions(para, opts);
+    for (size_t i = 0; i < items.size(); i++) {
+      if (!Process(para, items[i])) {
+        SetErrorMessage("The bidi algorithm failed");
+        break;
+      }
+    }
+    ubidi_close(para);
+  }
+
+protected:
+  void HandleOKCallback() {
+    Nan::HandleScope scope;
+    bidi_AddStats(&addon->stats, stats);
+    Local<Array> results = Nan::New<Array>(items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+      Item &item = items[i];
+      Local<Object> result = Nan::New<Object>();
+      Nan::Set(result, NEW_STR("reordered"), item.reorderedLength == 0 ?
+        Nan::EmptyString() :
+        Nan::New<String>(&reordered[item.reorderedStart],
+                         item.reorderedLength).ToLocalChecked());
+      Nan::Set(result, NEW_STR("paraLevel"), Nan::New(item.paraLevel));
+      Nan::Set(result, NEW_STR("processedLength"),
+               Nan::New(item.processedLength));
+      Nan::Set(result, NEW_STR("resultLength"), Nan::New(item.resultLength));
+      Nan::Set(result, NEW_STR("dir"), dir2str(addon, item.direction));
+      if (wantLevels) {
+        Local<Object> array;
+        UBiDiLevel *dest = NULL;
+        bidi_OutputArray<Uint8Array>(Nan::Undefined(), &Value::IsUint8Array,
+                                     item.levelsLength, &array, &dest);
+        if (item.levelsLength > 0) {
+          std::memcpy(dest, &levels[item.levelsStart],
+                      item.levelsLength * sizeof(UBiDiLevel));
+        }
+        Nan::Set(result, NEW_STR("levels"), array);
+      }
+      if (wantRuns) {
+        Local<Object> array;
+        int32_t *dest = NULL;
+        bidi_OutputArray<Int32Array>(Nan::Undefined(), &Value::IsInt32Array,
+                                     item.runsLength, &array, &dest);
+        if (item.runsLength > 0) {
+          std::memcpy(dest, &runs[item.runsStart],
+                      item.runsLength * sizeof(int32_t));
+        }
+        Nan::Set(result, NEW_STR("runs"), array);
+      }
+      if (wantParagraphs) {
+        Local<Object> array;
+        int32_t *dest = NULL;
+        bidi_OutputArray<Int32Array>(Nan::Undefined(), &Value::IsInt32Array,
+                                     item.paragraphsLength, &array, &dest);
+        if (item.paragraphsLength > 0) {
+          std::memcpy(dest, &paragraphs[item.paragraphsStart],
+                      item.paragraphsLength * sizeof(int32_t));
+        }
+        Nan::Set(result, NEW_STR("paragraphs"), array);
+      }
+      Nan::Set(results, i, result);
+    }
+    Local<Value> argv[2] = { Nan::Null(), results };
+    callback->Call(2, argv);
+  }
+
+  void HandleErrorCallback() {
+    Nan::HandleScope scope;
+    bidi_AddStats(&addon->stats, stats);
+    Local<Value> argv[1] = {
+      U_FAILURE(errorCode) ? bidi_MakeError(errorCode) :
+        Nan::Error(ErrorMessage())
+    };
+    callback->Call(1, argv);
+  }
+
+private:
+  // Append input to the given buffer, returning its length.
+  static int32_t Copy(const BidiInput &input, std::vector<UChar> *buffer) {
+    size_t start = buffer->size();
+    buffer->resize(start + input.length);
+    int32_t length = input.length == 0 ? 0 :
+      bidi_CopyInput(input, &(*buffer)[start]);
+    buffer->resize(start + length);
+    return length;
+  }
+
+  struct Item {
+    size_t start;
+    int32_t length;
+    size_t reorderedStart, levelsStart, runsStart, paragraphsStart;
+    int32_t reorderedLength, levelsLength, runsLength, paragraphsLength;
+    int32_t processedLength, resultLength;
+    UBiDiLevel paraLevel;
+    UBiDiDirection direction;
+  };
+
+  bool Process(UBiDi *para, Item &item) {
+    stats.bytesProcessed += item.length * sizeof(UChar);
+    if (defaultLTR && item.length > 0 &&
+        bidi_IsSimpleLTR(&text[item.start], item.length)) {
+      ProcessSimpleLTR(item);
+      return true;
+    }
+    // ubidi_setPara rejects a NULL pointer, even for empty text.
+    static const UChar empty[1] = { 0 };
+    const UChar *itemText = item.length == 0 ? empty : &text[item.start];
+    if (!prologue.empty() || !epilogue.empty()) {
+      ubidi_setContext(
+        para, prologue.empty() ? NULL : &prologue[0], prologue.size(),
+        epilogue.empty() ? NULL : &epilogue[0], epilogue.size(),
+        &errorCode
+      );
+    }
+    BIDI_TIMED(stats, setPara, ubidi_setPara(
+      para, itemText, item.length, opts.paraLevel, NULL, &errorCode
+    ));
+    if (U_FAILURE(errorCode)) { return false; }
+    item.paraLevel = ubidi_getParaLevel(para);
+    item.direction = ubidi_getDirection(para);
+    item.processedLength = ubidi_getProcessedLength(para);
+    item.resultLength = ubidi_getResultLength(para);
+
+    int32_t destSize = bidi_ReorderedSize(para, writeOptions, &errorCode);
+    if (U_FAILURE(errorCode)) { return false; }
+    item.reorderedStart = reordered.size();
+    reordered.resize(item.reorderedStart + destSize);
+    item.reorderedLength = 0;
+    if (destSize > 0) {
+      BIDI_TIMED(stats, writeReordered, item.reorderedLength =
+        ubidi_writeReordered(para, &reordered[item.reorderedStart],
+                             destSize, writeOptions, &errorCode));
+    }
+    if (U_FAILURE(errorCode)) { return false; }
+    reordered.resize(item.reorderedStart + item.reorderedLength);
+
+    item.levelsStart = levels.size();
+    item.levelsLength = 0;
+    if (wantLevels) {
+      item.levelsLength = ubidi_getProcessedLength(para);
+      if (item.levelsLength > 0) {
+        const UBiDiLevel *l = ubidi_getLevels(para, &errorCode);
+        if (U_FAILURE(errorCode)) { return false; }
+        levels.insert(levels.end(), l, l + item.levelsLength);
+      }
+    }
+
+    item.runsStart = runs.size();
+    item.runsLength = 0;
+    if (wantRuns) {
+      int32_t count = ubidi_countRuns(para, &errorCode);
+      if (U_FAILURE(errorCode)) { return false; }
+      item.runsLength = 3 * count;
+      runs.resize(item.runsStart + item.runsLength);
+      // (logicalStart, length, level) triples, as for Paragraph#getRuns
+      int32_t *dest = item.runsLength == 0 ? NULL : &runs[item.runsStart];
+      for (int32_t i = 0; i < count; i++, dest += 3) {
+        ubidi_getVisualRun(para, i, &dest[0], &dest[1]);
+        dest[2] = ubidi_getLevelAt(para, dest[0]);
+      }
+    }
+
+    item.paragraphsStart = paragraphs.size();
+    item.paragraphsLength = 0;
+    if (wantParagraphs) {
+      int32_t count = ubidi_countParagraphs(para);
+      item.paragraphsLength = 3 * count;
+      paragraphs.resize(item.paragraphsStart + item.paragraphsLength);
+      // (start, limit, level) triples
+      int32_t *dest = item.paragraphsLength == 0 ? NULL :
+        &paragraphs[item.paragraphsStart];
+      for (int32_t i = 0; i < count; i++, dest += 3) {
+        UBiDiLevel level;
+        ubidi_getParagraphByIndex(para, i, &dest[0], &dest[1], &level,
+                                  &errorCode);
+        dest[2] = level;
+      }
+      if (U_FAILURE(errorCode)) { return false; }
+    }
+    return true;
+  }
+
+  // Plain LTR text doesn't need ICU at all: it's a single run at level 0.
+  void ProcessSimpleLTR(Item &item) {
+    item.paraLevel = 0;
+    item.direction = UBIDI_LTR;
+    item.processedLength = item.resultLength = item.length;
+    item.reorderedStart = reordered.size();
+    item.reorderedLength = item.length;
+    reordered.insert(reordered.end(), text.begin() + item.start,
+                     text.begin() + item.start + item.length);
+    item.levelsStart = levels.size();
+    item.levelsLength = wantLevels ? item.length : 0;
+    levels.resize(item.levelsStart + item.levelsLength, 0);
+    item.runsStart = runs.size();
+    item.runsLength = 0;
+    if (wantRuns) {
+      item.runsLength = 3;
+      runs.push_back(0);
+      runs.push_back(item.length);
+      runs.push_back(0);
+    }
+    item.paragraphsStart = paragraphs.size();
+    item.paragraphsLength = 0;
+    if (wantParagraphs) {
+      item.paragraphsLength = 3;
+      paragraphs.push_back(0);
+      paragraphs.push_back(item.length);
+      paragraphs.push_back(0);
+    }
+  }
+
+  BidiAddon *addon;
+  BidiOptions opts;
+  uint16_t writeOptions;
+  bool wantLevels, wantRuns, wantParagraphs, defaultLTR;
+  int32_t maxLength;
+  UErrorCode errorCode;
+  // added to the global stats on the main thread once we're done.
+  BidiStats stats;
+  // All strings share one buffer for input and one for output.
+  std::vector<UChar> prologue, epilogue, text, reordered;
+  std::vector<UBiDiLevel> levels;
+  std::vector<int32_t> runs, paragraphs;
+  std::vector<Item> items;
+};
+
+NAN_METHOD(ProcessBatch) {
+  BidiTraceScope trace("processBatch");
+  if (info.Length() < 3 || !info[0]->IsArray() || !info[2]->IsFunction()) {
+    return Nan::ThrowTypeError(
+      "Expected an array of strings, an options hash and a callback"
+    );
+  }
+  Local<Array> texts = info[0].As<Array>();
+  Nan::MaybeLocal<Object> maybeOptions = Nan::To<Object>(info[1]);
+  if (maybeOptions.IsEmpty()) {
+    return Nan::ThrowTypeError("Second argument should be an options hash");
+  }
+  Local<Object> options = maybeOptions.ToLocalChecked();
+  BidiOptions opts;
+  if (!bidi_ParseOptions(options, &opts)) {
+    return;
+  }
+  uint16_t writeOptions = (uint16_t)
+    CAST_INT(GET_PROPERTY(options, "writeOptions"), 0);
+  bool wantLevels = CAST_BOOL(GET_PROPERTY(options, "levels"), false);
+  bool wantRuns = CAST_BOOL(GET_PROPERTY(options, "runs"), false);
+  bool wantParagraphs =
+    CAST_BOOL(GET_PROPERTY(options, "paragraphs"), false);
+
+  Nan::Callback *callback = new Nan::Callback(info[2].As<Function>());
+  BatchWorker *worker = new BatchWorker(
+    callback, bidi_GetAddon(info.Data()), opts, writeOptions,
+    wantLevels, wantRuns, wantParagraphs
+  );
+  for (uint32_t i = 0; i < texts->Length(); i++) {
+    Local<Value> value =
+      Nan::Get(texts, i).FromMaybe((Local<Value>) Nan::Undefined());
+    if (!value->IsArrayBufferView()) {
+      Nan::MaybeLocal<String> maybeText = Nan::To<String>(value);
+      if (maybeText.IsEmpty()) {
+        delete worker;
+        return Nan::ThrowTypeError(
+          "Batch entries couldn't be converted to strings"
+        );
+      }
+      value = maybeText.ToLocalChecked();
+    }
+    BidiInput input;
+    if (!bidi_ParseInput(value, opts.encoding, &input)) {
+      delete worker;
+      return;
+    }
+    worker->AddText(input);
+  }
+  Nan::AsyncQueueWorker(worker);
+}
@@ -0,0 +1,257 @@
+#ifndef NODE_ICU_BIDI_SRC_BIDI_H
+#define NODE_ICU_BIDI_SRC_BIDI_H
+
+#include <node.h>
+#include <v8.h>
+#include <uv.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "unicode/ubidi.h"
+
+#include "nan.h"
+#include "macros.h"
+
+enum BidiEncoding { BIDI_UTF8, BIDI_UTF16LE };
+
+// V8 8 (node 14) and later let us share ownership of the memory behind
+// an ArrayBuffer, which then outlives the ArrayBuffer being detached or
+// transferred to another thread.
+#if defined(V8_MAJOR_VERSION) && V8_MAJOR_VERSION >= 8
+#define BIDI_HAVE_BACKING_STORE 1
+#endif
+
+/* A piece of text passed in from JavaScript: a string, a Uint16Array, or
+ * a Buffer holding UTF-8 or UTF-16LE.  UTF-16 data which is suitably
+ * aligned can be used in place, as long as its memory can't be freed
+ * under us (see bidi_CanBorrow()); anything else must be copied into a
+ * buffer of at least `length` code units with bidi_CopyInput(). */
+struct BidiInput {
+  enum { STRING, UTF16, UTF16LE_BYTES, UTF8_BYTES } kind;
+  v8::Local<v8::Value> value;
+  const UChar *data;  // for UTF16
+  const char *bytes;  // for UTF16LE_BYTES and UTF8_BYTES
+  int32_t length;     // in UTF-16 code units; an upper bound for UTF8_BYTES
+  bool borrowable;    // for UTF16: may be used in place
+  bool IsBorrowed() const { return kind == UTF16 && borrowable; }
+};
+
+bool bidi_ParseInput(v8::Local<v8::Value> value, BidiEncoding encoding,
+                     BidiInput *input);
+int32_t bidi_CopyInput(const BidiInput &input, UChar *dest);
+
+/* Settings parsed from a JavaScript options hash.  They are parsed on the
+ * main thread and can then be applied to a UBiDi object later, possibly
+ * from a worker thread. */
+struct BidiOptions {
+  UBiDiLevel paraLevel;
+  int32_t reorderingMode;     // -1 if unset
+  int32_t reorderingOptions;  // -1 if unset
+  int inverse;                // -1 if unset
+  int orderParagraphsLTR;     // -1 if unset
+  BidiEncoding encoding;
+  BidiInput prologue;
+  BidiInput epilogue;
+  // Explicit levels from a Uint8Array; NULL if unset.  They are only
+  // valid in the current handle scope, and ICU may modify them, so a
+  // Paragraph uses its own copy.
+  UBiDiLevel *embeddingLevels;
+  int32_t embeddingLevelsLength;
+};
+
+bool bidi_ParseOptions(v8::Local<v8::Object> options, BidiOptions *opts);
+void bidi_ApplyOptions(UBiDi *para, const BidiOptions &opts);
+
+/* The size of the buffer needed to hold the result of
+ * ubidi_writeReordered() with the given options. */
+int32_t bidi_ReorderedSize(UBiDi *para, uint16_t options,
+                           UErrorCode *errorCode);
+
+/* A quick, conservative test for text which the bidi algorithm would
+ * resolve to a single left-to-right run at level 0 (given options for
+ * which bidi_IsDefaultLTR() is true), so that ICU can be skipped. */
+bool bidi_IsSimpleLTR(const UChar *text, int32_t length);
+bool bidi_IsDefaultLTR(const BidiOptions &opts);
+/* The level ICU would give the first paragraph of `text` (without a
+ * prologue), without running the bidi algorithm. */
+UBiDiLevel bidi_FirstParaLevel(const UChar *text, int32_t length,
+                               UBiDiLevel paraLevel);
+
+/* Counters reported by ubidi.stats().  Each instance of the addon has
+ * its own, only touched on its own thread; batch workers keep theirs
+ * separately and add them in with bidi_AddStats() when they finish.
+ * Times are in nanoseconds. */
+struct BidiStats {
+  uint64_t paragraphsCreated, paragraphsLive;
+  uint64_t linesCreated, linesLive;
+  uint64_t bytesProcessed;   // UTF-16 text given to the bidi algorithm
+  int64_t nativeBytes;       // text buffers and UBiDi objects held
+  uint64_t setParaCalls, setParaTime;
+  uint64_t writeReorderedCalls, writeReorderedTime;
+  uint64_t cacheHits, cacheMisses;
+};
+void bidi_AddStats(BidiStats *to, const BidiStats &from);
+
+/* Evaluate `expr`, adding the time it took to `stats.<counter>Time`. */
+#define BIDI_TIMED(stats, counter, expr)                            \
+  do {                                                              \
+    uint64_t bidi_t0 = uv_hrtime();                                 \
+    expr;                                                           \
+    (stats).counter##Time += uv_hrtime() - bidi_t0;                 \
+    (stats).counter##Calls++;                                       \
+  } while (false)
+
+// Node 10 and later give addons the tracing controller behind
+// --trace-event-categories and trace_events.createTracing().
+#if NODE_MODULE_VERSION >= NODE_10_0_MODULE_VERSION && \
+    !defined(V8_USE_PERFETTO)
+#define BIDI_HAVE_TRACING 1
+#endif
+
+/* Records a trace event in the `icu-bidi` category covering the
+ * lifetime of this object, when that category is enabled.  The flag is
+ * checked each time, since tracing can be started and stopped at run
+ * time.  Safe to use on any thread. */
+class BidiTraceScope {
+public:
+  explicit BidiTraceScope(const char *name);
+  ~BidiTraceScope();
+private:
+  const char *name;
+  bool started;
+  uint64_t handle;
+};
+
+/* A rough guess at the memory ICU allocates for a UBiDi opened with
+ * ubidi_openSized(maxLength, 0): the object itself, plus a direction
+ * property and a level for each character.  Runs and other scratch
+ * arrays are allocated on demand, and aren't counted. */
+#define BIDI_UBIDI_SIZE(maxLength) (1024 + 2 * (int64_t) (maxLength))
+
+/* A resolved paragraph in the result cache, shared (read only) by every
+ * Paragraph constructed with the same text and options.  Its UBiDi
+ * holds the levels and runs; reordered text is kept per set of
+ * writeReordered() options. */
+struct BidiCacheEntry {
+  uint64_t hash;
+  UBiDiLevel paraLevel;
+  int32_t reorderingMode, reorderingOptions;
+  int inverse, orderParagraphsLTR;
+  // our own copy of the (prologue, text, epilogue).
+  std::vector<UChar> text;
+  const UChar *start[3];
+  int32_t length[3];
+  UBiDi *para;
+  int refs;
+  std::vector<std::pair<uint16_t, std::vector<UChar> > > reordered;
+};
+
+/* The entries in least-recently-used order, with an index by hash. */
+struct BidiCache {
+  typedef std::list<BidiCacheEntry *> List;
+  List entries;
+  std::map<uint64_t, List::iterator> index;
+  size_t size;  // 0 (the default) turns the cache off
+};
+
+/* Strings which we return as property names or values, made once for
+ * each instance of the addon rather than on every call. */
+enum BidiString {
+  BIDI_STR_LTR, BIDI_STR_RTL, BIDI_STR_MIXED, BIDI_STR_NEUTRAL,
+  BIDI_STR_DIR, BIDI_STR_LOGICAL_START, BIDI_STR_LENGTH,
+  BIDI_STR_LOGICAL_LIMIT, BIDI_STR_LEVEL, BIDI_STR_INDEX, BIDI_STR_START,
+  BIDI_STR_LIMIT,
+  BIDI_STR_COUNT
+};
+
+/* The shapes of the objects returned by getVisualRun(), getLogicalRun()
+ * and getParagraph()/getParagraphByIndex().  Each is made from a template
+ * with its properties already in place, so that every result has the
+ * same hidden class. */
+enum BidiShape {
+  BIDI_SHAPE_VISUAL_RUN, BIDI_SHAPE_LOGICAL_RUN, BIDI_SHAPE_PARAGRAPH,
+  BIDI_SHAPE_COUNT
+};
+
+/* The state belonging to one instance of the addon.  Each worker thread
+ * which loads us gets its own instance, with its own isolate, so nothing
+ * here is shared between threads.  An instance is freed once its
+ * environment has gone away and nothing which refers to it (a Paragraph
+ * or a pending batch) is left. */
+struct BidiAddon {
+  BidiAddon() : stats(), refs(1) { cache.size = 0; }
+  BidiStats stats;
+  BidiCache cache;
+  Nan::Persistent<v8::FunctionTemplate> paragraphTemplate;
+  Nan::Persistent<v8::String> strings[BIDI_STR_COUNT];
+  Nan::Persistent<v8::ObjectTemplate> shapes[BIDI_SHAPE_COUNT];
+  int refs;
+};
+
+/* The instance passed as the data of a function template. */
+BidiAddon *bidi_GetAddon(v8::Local<v8::Value> data);
+void bidi_AddonRef(BidiAddon *addon);
+void bidi_AddonUnref(BidiAddon *addon);
+/* Count native memory we've allocated (or freed) in the stats, and tell
+ * V8 about it, so that it collects garbage as soon as it should. */
+void bidi_AdjustNativeBytes(BidiAddon *addon, int64_t change);
+
+void bidi_SetCacheSize(BidiAddon *addon, size_t size);
+/* Find or create the entry for the given text and options, and take a
+ * reference to it.  Returns NULL if ICU failed.  Options with explicit
+ * embedding levels can't be cached. */
+BidiCacheEntry *bidi_CacheGet(BidiAddon *addon, const UChar *const start[3],
+                              const int32_t length[3],
+                              const BidiOptions &opts,
+                              UErrorCode *errorCode);
+void bidi_CacheRelease(BidiAddon *addon, BidiCacheEntry *entry);
+const std::vector<UChar> *bidi_CacheReordered(BidiAddon *addon,
+                                              BidiCacheEntry *entry,
+                                              uint16_t options,
+                                              UErrorCode *errorCode);
+
+v8::Local<v8::Value> bidi_MakeError(UErrorCode code);
+void bidi_InitStrings(BidiAddon *addon);
+void bidi_FreeStrings(BidiAddon *addon);
+v8::Local<v8::String> bidi_String(BidiAddon *addon, BidiString str);
+/* Make a result of the given shape; `values` are in the order of its
+ * properties. */
+v8::Local<v8::Object> bidi_NewResult(BidiAddon *addon, BidiShape shape,
+                                     const v8::Local<v8::Value> values[]);
+v8::Local<v8::Value> dir2str(BidiAddon *addon, UBiDiDirection dir);
+
+NAN_METHOD(ProcessBatch);
+
+/* Find a typed array to hold `length` elements of output.  If the caller
+ * supplied an array of the right type in `arg` we write into it, so that
+ * hot loops can reuse a single buffer; otherwise a fresh array is
+ * allocated.  Returns false (with an exception pending) on failure. */
+template <typename array_t, typename elem_t>
+static bool bidi_OutputArray(v8::Local<v8::Value> arg,
+                             bool (v8::Value::*isType)() const,
+                             int32_t length, v8::Local<v8::Object> *result,
+                             elem_t **data) {
+  if (arg->IsUndefined() || arg->IsNull()) {
+    v8::Local<v8::ArrayBuffer> buffer = v8::ArrayBuffer::New(
+      v8::Isolate::GetCurrent(), length * sizeof(elem_t)
+    );
+    *result = array_t::New(buffer, 0, length);
+  } else if (((*arg)->*isType)()) {
+    *result = arg.As<v8::Object>();
+  } else {
+    Nan::ThrowTypeError("Output argument has the wrong typed array type");
+    return false;
+  }
+  Nan::TypedArrayContents<elem_t> contents(*result);
+  if (contents.length() < (size_t) length) {
+    Nan::ThrowRangeError("Output array is too small");
+    return false;
+  }
+  *data = *contents;
+  return true;
+}
+
+#endif
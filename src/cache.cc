@@ -0,0 +1,184 @@
+#include <cstring> // for std::memcmp
+#include <vector>
+
+#include "unicode/ubidi.h"
+
+#include "bidi.h"
+
+/* 64-bit FNV-1a, one code unit at a time. */
+static inline uint64_t bidi_Hash(uint64_t h, uint32_t value) {
+  return (h ^ value) * 1099511628211ULL;
+}
+
+static uint64_t bidi_CacheKey(const UChar *const start[3],
+                              const int32_t length[3],
+                              const BidiOptions &opts) {
+  uint64_t h = 14695981039346656037ULL;
+  h = bidi_Hash(h, opts.paraLevel);
+  h = bidi_Hash(h, (uint32_t) opts.reorderingMode);
+  h = bidi_Hash(h, (uint32_t) opts.reorderingOptions);
+  h = bidi_Hash(h, (uint32_t) opts.inverse);
+  h = bidi_Hash(h, (uint32_t) opts.orderParagraphsLTR);
+  for (int i = 0; i < 3; i++) {
+    h = bidi_Hash(h, (uint32_t) length[i]);
+    for (int32_t j = 0; j < length[i]; j++) {
+      h = bidi_Hash(h, start[i][j]);
+    }
+  }
+  return h;
+}
+
+static bool bidi_CacheMatches(const BidiCacheEntry *entry,
+                              const UChar *const start[3],
+                              const int32_t length[3],
+                              const BidiOptions &opts) {
+  if (entry->paraLevel != opts.paraLevel ||
+      entry->reorderingMode != opts.reorderingMode ||
+      entry->reorderingOptions != opts.reorderingOptions ||
+      entry->inverse != opts.inverse ||
+      entry->orderParagraphsLTR != opts.orderParagraphsLTR) {
+    return false;
+  }
+  for (int i = 0; i < 3; i++) {
+    if (entry->length[i] != length[i] ||
+        0 != std::memcmp(entry->start[i], start[i],
+                         length[i] * sizeof(UChar))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int64_t bidi_CacheEntrySize(const BidiCacheEntry *entry) {
+  int64_t size = sizeof(BidiCacheEntry) +
+    (int64_t) entry->text.size() * sizeof(UChar) +
+    BIDI_UBIDI_SIZE(entry->length[1]);
+  for (size_t i = 0; i < entry->reordered.size(); i++) {
+    size += entry->reordered[i].second.size() * sizeof(UChar);
+  }
+  return size;
+}
+
+static void bidi_CacheEvict(BidiAddon *addon, size_t size) {
+  BidiCache &cache = addon->cache;
+  while (cache.entries.size() > size) {
+    BidiCacheEntry *entry = cache.entries.back();
+    cache.entries.pop_back();
+    cache.index.erase(entry->hash);
+    bidi_CacheRelease(addon, entry);
+  }
+}
+
+void bidi_SetCacheSize(BidiAddon *addon, size_t size) {
+  addon->cache.size = size;
+  bidi_CacheEvict(addon, size);
+}
+
+/* Entries are reference counted: one reference is held by the cache
+ * itself, and one by each Paragraph sharing the entry, so evicted
+ * entries live on until the last Paragraph using them lets go. */
+void bidi_CacheRelease(BidiAddon *addon, BidiCacheEntry *entry) {
+  if (--entry->refs > 0) {
+    return;
+  }
+  bidi_AdjustNativeBytes(addon, -bidi_CacheEntrySize(entry));
+  if (entry->para != NULL) {
+    ubidi_close(entry->para);
+  }
+  delete entry;
+}
+
+BidiCacheEntry *bidi_CacheGet(BidiAddon *addon, const UChar *const start[3],
+                              const int32_t length[3],
+                              const BidiOptions &opts,
+                              UErrorCode *errorCode) {
+  BidiCache &cache = addon->cache;
+  uint64_t hash = bidi_CacheKey(start, length, opts);
+  std::map<uint64_t, BidiCache::List::iterator>::iterator found =
+    cache.index.find(hash);
+  if (found != cache.index.end()) {
+    BidiCacheEntry *entry = *found->second;
+    if (bidi_CacheMatches(entry, start, length, opts)) {
+      // Move it to the front of the list.
+      cache.entries.splice(cache.entries.begin(), cache.entries,
+                           found->second);
+      addon->stats.cacheHits++;
+      entry->refs++;
+      return entry;
+    }
+    // A hash collision: the newer text wins.
+    bidi_CacheRelease(addon, entry);
+    cache.entries.erase(found->second);
+    cache.index.erase(found);
+  }
+  addon->stats.cacheMisses++;
+
+  // Run the bidi algorithm on our own copy of the text.
+  BidiCacheEntry *entry = new BidiCacheEntry();
+  entry->hash = hash;
+  entry->paraLevel = opts.paraLevel;
+  entry->reorderingMode = opts.reorderingMode;
+  entry->reorderingOptions = opts.reorderingOptions;
+  entry->inverse = opts.inverse;
+  entry->orderParagraphsLTR = opts.orderParagraphsLTR;
+  // ICU won't accept NULL, even for empty text.
+  entry->text.resize(length[0] + length[1] + length[2] + 1);
+  int32_t offset = 0;
+  for (int i = 0; i < 3; i++) {
+    entry->start[i] = &entry->text[offset];
+    entry->length[i] = length[i];
+    if (length[i] > 0) {
+      std::memcpy(&entry->text[offset], start[i], length[i] * sizeof(UChar));
+    }
+    offset += length[i];
+  }
+  entry->refs = 1;
+  entry->para = ubidi_openSized(length[1], 0, errorCode);
+  if (U_SUCCESS(*errorCode)) {
+    bidi_ApplyOptions(entry->para, opts);
+    if (length[0] != 0 || length[2] != 0) {
+      ubidi_setContext(entry->para, entry->start[0], length[0],
+                       entry->start[2], length[2], errorCode);
+    }
+  }
+  if (U_SUCCESS(*errorCode)) {
+    BIDI_TIMED(addon->stats, setPara, ubidi_setPara(
+      entry->para, entry->start[1], length[1], opts.paraLevel, NULL,
+      errorCode
+    ));
+  }
+  bidi_AdjustNativeBytes(addon, bidi_CacheEntrySize(entry));
+  if (U_FAILURE(*errorCode)) {
+    bidi_CacheRelease(addon, entry);
+    return NULL;
+  }
+
+  cache.entries.push_front(entry);
+  cache.index[hash] = cache.entries.begin();
+  entry->refs++;
+  bidi_CacheEvict(addon, cache.size);
+  return entry;
+}
+
+const std::vector<UChar> *bidi_CacheReordered(BidiAddon *addon,
+                                              BidiCacheEntry *entry,
+                                              uint16_t options,
+                                              UErrorCode *errorCode) {
+  for (size_t i = 0; i < entry->reordered.size(); i++) {
+    if (entry->reordered[i].first == options) {
+      return &entry->reordered[i].second;
+    }
+  }
+  int32_t destSize = bidi_ReorderedSize(entry->para, options, errorCode);
+  if (U_FAILURE(*errorCode)) { return NULL; }
+  std::vector<UChar> result(destSize > 0 ? destSize : 1);
+  int32_t length;
+  BIDI_TIMED(addon->stats, writeReordered, length = ubidi_writeReordered(
+    entry->para, &result[0], destSize, options, errorCode
+  ));
+  if (U_FAILURE(*errorCode)) { return NULL; }
+  result.resize(length);
+  bidi_AdjustNativeBytes(addon, length * sizeof(UChar));
+  entry->reordered.push_back(std::make_pair(options, result));
+  return &entry->reordered.back().second;
+}
@@ -1,11 +1,28 @@
 #include <node.h>
 #include <v8.h>
 #include <cstring> // for std::memcpy
+#include <vector>
 
 #include "unicode/ubidi.h"
+#include "unicode/ushape.h"
+#include "unicode/ustring.h"
 
 #include "nan.h"
 #include "macros.h"
+#include "bidi.h"
+
+// V8's fast API calls, in the form where a fast call can hand over to
+// the slow one by setting `fallback` (which newer versions removed).
+// Not every node release ships the header, so check for it as well.
+#if defined(V8_MAJOR_VERSION) && (V8_MAJOR_VERSION == 10 || \
+    V8_MAJOR_VERSION == 11 || (V8_MAJOR_VERSION == 12 && V8_MINOR_VERSION <= 4))
+#if defined(__has_include)
+#if __has_include(<v8-fast-api-calls.h>)
+#define BIDI_FAST_API 1
+#include <v8-fast-api-calls.h>
+#endif
+#endif
+#endif
 
 using namespace v8;
 
@@ -20,7 +37,31 @@ static void bidi_SetPrototypeMethod(target_t target, const char *name,
   Nan::SetPrototypeTemplate(target, name, templ);
 }
 
-static Local<Value> bidi_MakeError(UErrorCode code) {
+#ifdef BIDI_FAST_API
+/* Call a NAN_METHOD from a plain V8 callback. */
+template <Nan::FunctionCallback callback>
+static void bidi_SlowCall(const v8::FunctionCallbackInfo<Value> &info) {
+  callback(Nan::FunctionCallbackInfo<Value>(info, info.Data()));
+}
+
+/* Like bidi_SetPrototypeMethod, but also giving V8 a fast version of the
+ * method to call from optimized code. */
+template <Nan::FunctionCallback callback>
+static void bidi_SetFastPrototypeMethod(Local<FunctionTemplate> target,
+                                        const char *name,
+                                        const CFunction *fast) {
+  Nan::HandleScope scope;
+  Isolate *isolate = Isolate::GetCurrent();
+  Local<FunctionTemplate> templ = FunctionTemplate::New(
+    isolate, bidi_SlowCall<callback>, Local<Value>(),
+    Signature::New(isolate, target), 0, ConstructorBehavior::kThrow,
+    SideEffectType::kHasSideEffect, fast
+  );
+  Nan::SetPrototypeTemplate(target, name, templ);
+}
+#endif
+
+Local<Value> bidi_MakeError(UErrorCode code) {
   Nan::EscapableHandleScope scope;
   Local<Value> err = Nan::Error("The bidi algorithm failed");
   Local<Object> obj = Nan::To<Object>(err).ToLocalChecked();
@@ -28,19 +69,393 @@ static Local<Value> bidi_MakeError(UErrorCode code) {
   return scope.Escape(err);
 }
 
-static Local<Value> dir2str(UBiDiDirection dir) {
+static const char *const bidi_Strings[BIDI_STR_COUNT] = {
+  "ltr", "rtl", "mixed", "neutral",
+  "dir", "logicalStart", "length",
+  "logicalLimit", "level", "index", "start",
+  "limit"
+};
+
+// The properties of each BidiShape, ending with BIDI_STR_COUNT.
+static const BidiString bidi_ShapeKeys[BIDI_SHAPE_COUNT][6] = {
+  { BIDI_STR_DIR, BIDI_STR_LOGICAL_START, BIDI_STR_LENGTH, BIDI_STR_COUNT },
+  { BIDI_STR_LOGICAL_LIMIT, BIDI_STR_LEVEL, BIDI_STR_DIR, BIDI_STR_COUNT },
+  { BIDI_STR_INDEX, BIDI_STR_START, BIDI_STR_LIMIT, BIDI_STR_LEVEL,
+    BIDI_STR_DIR, BIDI_STR_COUNT }
+};
+
+void bidi_InitStrings(BidiAddon *addon) {
+  Nan::HandleScope scope;
+  for (int i = 0; i < BIDI_STR_COUNT; i++) {
+#if NODE_MODULE_VERSION >= NODE_4_0_MODULE_VERSION
+    // Internalized, so that V8 can use them as property names as is.
+    Local<String> str = String::NewFromUtf8(
+      v8::Isolate::GetCurrent(), bidi_Strings[i],
+      v8::NewStringType::kInternalized
+    ).ToLocalChecked();
+#else
+    Local<String> str = NEW_STR(bidi_Strings[i]);
+#endif
+    addon->strings[i].Reset(str);
+  }
+  for (int i = 0; i < BIDI_SHAPE_COUNT; i++) {
+    Local<ObjectTemplate> t = Nan::New<ObjectTemplate>();
+    for (const BidiString *key = bidi_ShapeKeys[i];
+         *key != BIDI_STR_COUNT; key++) {
+      Nan::SetTemplate(t, bidi_String(addon, *key), Nan::Undefined(),
+                       v8::None);
+    }
+    addon->shapes[i].Reset(t);
+  }
+}
+
+void bidi_FreeStrings(BidiAddon *addon) {
+  for (int i = 0; i < BIDI_STR_COUNT; i++) {
+    addon->strings[i].Reset();
+  }
+  for (int i = 0; i < BIDI_SHAPE_COUNT; i++) {
+    addon->shapes[i].Reset();
+  }
+}
+
+Local<String> bidi_String(BidiAddon *addon, BidiString str) {
+  return Nan::New(addon->strings[str]);
+}
+
+Local<Object> bidi_NewResult(BidiAddon *addon, BidiShape shape,
+                             const Local<Value> values[]) {
   Nan::EscapableHandleScope scope;
-  return scope.Escape(dir == UBIDI_LTR ? NEW_STR("ltr") :
-                        dir == UBIDI_RTL ? NEW_STR("rtl") :
-                        dir == UBIDI_MIXED ? NEW_STR("mixed") :
-                        dir == UBIDI_NEUTRAL ? NEW_STR("neutral") :
-                        NEW_STR("<bad dir>" /* should never happen */));
+  Local<Object> result =
+    Nan::NewInstance(Nan::New(addon->shapes[shape])).ToLocalChecked();
+  const BidiString *keys = bidi_ShapeKeys[shape];
+  for (int i = 0; keys[i] != BIDI_STR_COUNT; i++) {
+    Nan::Set(result, bidi_String(addon, keys[i]), values[i]);
+  }
+  return scope.Escape(result);
+}
+
+Local<Value> dir2str(BidiAddon *addon, UBiDiDirection dir) {
+  switch (dir) {
+  case UBIDI_LTR: return bidi_String(addon, BIDI_STR_LTR);
+  case UBIDI_RTL: return bidi_String(addon, BIDI_STR_RTL);
+  case UBIDI_MIXED: return bidi_String(addon, BIDI_STR_MIXED);
+  case UBIDI_NEUTRAL: return bidi_String(addon, BIDI_STR_NEUTRAL);
+  default: return NEW_STR("<bad dir>"); /* should never happen */
+  }
+}
+
+void bidi_AddStats(BidiStats *to, const BidiStats &from) {
+  to->paragraphsCreated += from.paragraphsCreated;
+  to->paragraphsLive += from.paragraphsLive;
+  to->linesCreated += from.linesCreated;
+  to->linesLive += from.linesLive;
+  to->bytesProcessed += from.bytesProcessed;
+  to->nativeBytes += from.nativeBytes;
+  to->setParaCalls += from.setParaCalls;
+  to->setParaTime += from.setParaTime;
+  to->writeReorderedCalls += from.writeReorderedCalls;
+  to->writeReorderedTime += from.writeReorderedTime;
+  to->cacheHits += from.cacheHits;
+  to->cacheMisses += from.cacheMisses;
+}
+
+#ifdef BIDI_HAVE_TRACING
+static TracingController *bidi_GetTracingController() {
+#if NODE_MODULE_VERSION >= NODE_12_0_MODULE_VERSION
+  return node::GetTracingController();
+#else
+  node::MultiIsolatePlatform *platform =
+    node::GetMainThreadMultiIsolatePlatform();
+  return platform ? platform->GetTracingController() : NULL;
+#endif
+}
+
+/* The enabled flag of the icu-bidi category.  The controller owns it and
+ * updates it in place, so the pointer only needs looking up once; the
+ * static is initialized safely even when batch workers race for it. */
+static const uint8_t *bidi_LookUpTraceCategory() {
+  static const uint8_t disabled = 0;
+  TracingController *controller = bidi_GetTracingController();
+  return controller ?
+    controller->GetCategoryGroupEnabled("icu-bidi") : &disabled;
+}
+
+static const uint8_t *bidi_TraceCategory() {
+  static const uint8_t *enabled = bidi_LookUpTraceCategory();
+  return enabled;
+}
+#endif
+
+BidiTraceScope::BidiTraceScope(const char *name)
+  : name(name), started(false), handle(0) {
+#ifdef BIDI_HAVE_TRACING
+  const uint8_t *enabled = bidi_TraceCategory();
+  if (*enabled) {
+    handle = bidi_GetTracingController()->AddTraceEvent(
+      'X', enabled, name, NULL, 0, 0, 0, NULL, NULL, NULL, NULL, 0
+    );
+    started = true;
+  }
+#endif
+}
+
+BidiTraceScope::~BidiTraceScope() {
+#ifdef BIDI_HAVE_TRACING
+  if (started) {
+    bidi_GetTracingController()->UpdateTraceEventDuration(
+      bidi_TraceCategory(), name, handle
+    );
+  }
+#endif
+}
+
+BidiAddon *bidi_GetAddon(Local<Value> data) {
+  return (BidiAddon *) data.As<External>()->Value();
+}
+
+void bidi_AddonRef(BidiAddon *addon) {
+  addon->refs++;
+}
+
+void bidi_AddonUnref(BidiAddon *addon) {
+  if (--addon->refs == 0) {
+    delete addon;
+  }
+}
+
+void bidi_AdjustNativeBytes(BidiAddon *addon, int64_t change) {
+  if (change == 0) { return; }
+  addon->stats.nativeBytes += change;
+  // nan takes an int, so report big changes a piece at a time.
+  while (change > INT32_MAX || change < -INT32_MAX) {
+    int32_t piece = change > 0 ? INT32_MAX : -INT32_MAX;
+    Nan::AdjustExternalMemory(piece);
+    change -= piece;
+  }
+  Nan::AdjustExternalMemory((int) change);
 }
 
 static UBiDiDirection level2dir(UBiDiLevel level) {
     return (level&1) ? UBIDI_RTL : UBIDI_LTR;
 }
 
+/* Whether the memory of a typed array can be used in place.  Where V8
+ * lets us share ownership of it we can always do so; otherwise only if
+ * its ArrayBuffer can't be detached (by postMessage() with a transfer
+ * list, say), which would free the memory while we still point into it. */
+static bool bidi_CanBorrow(Local<Value> value) {
+#if defined(BIDI_HAVE_BACKING_STORE)
+  (void) value;
+  return true;
+#elif NODE_MODULE_VERSION >= NODE_12_0_MODULE_VERSION
+  return !value.As<ArrayBufferView>()->Buffer()->IsDetachable();
+#elif NODE_MODULE_VERSION >= NODE_10_0_MODULE_VERSION
+  return !value.As<ArrayBufferView>()->Buffer()->IsNeuterable();
+#else
+  (void) value;
+  return false;
+#endif
+}
+
+bool bidi_ParseInput(Local<Value> value, BidiEncoding encoding,
+                     BidiInput *input) {
+  input->value = value;
+  input->data = NULL;
+  input->bytes = NULL;
+  input->borrowable = false;
+  if (value->IsString()) {
+    input->kind = BidiInput::STRING;
+    input->length = value.As<String>()->Length();
+    return true;
+  }
+  size_t length;
+  if (value->IsUint16Array()) {
+    Nan::TypedArrayContents<uint16_t> contents(value);
+    input->kind = BidiInput::UTF16;
+    input->data = (const UChar *) *contents;
+    input->borrowable = bidi_CanBorrow(value);
+    length = contents.length();
+  } else {
+    Nan::TypedArrayContents<char> contents(value);
+    input->bytes = *contents;
+    length = contents.length();
+    if (encoding == BIDI_UTF8) {
+      input->kind = BidiInput::UTF8_BYTES;
+    } else if (length % 2 != 0) {
+      Nan::ThrowRangeError("UTF-16 input must have an even number of bytes");
+      return false;
+    } else {
+      length /= 2;
+      // Use the bytes in place unless they are misaligned or would need
+      // to be byte-swapped.
+      input->kind = (U_IS_BIG_ENDIAN ||
+                     ((uintptr_t) input->bytes) % sizeof(UChar) != 0) ?
+        BidiInput::UTF16LE_BYTES : BidiInput::UTF16;
+      input->data = (const UChar *) input->bytes;
+      input->borrowable = bidi_CanBorrow(value);
+    }
+  }
+  if (length > INT32_MAX) {
+    Nan::ThrowRangeError("Input is too long");
+    return false;
+  }
+  input->length = (int32_t) length;
+  return true;
+}
+
+/* Copy `length` UTF-16 code units of `str`, from `start`, into `dest`.
+ * Node 12 and later only have the form of String::Write which takes an
+ * isolate. */
+static int32_t bidi_WriteString(Local<String> str, UChar *dest,
+                                int32_t start, int32_t length) {
+#if NODE_MODULE_VERSION >= NODE_10_0_MODULE_VERSION
+  return str->Write(v8::Isolate::GetCurrent(), (uint16_t *) dest,
+                    start, length);
+#else
+  return str->Write((uint16_t *) dest, start, length);
+#endif
+}
+
+int32_t bidi_CopyInput(const BidiInput &input, UChar *dest) {
+  UErrorCode errorCode = U_ZERO_ERROR;
+  int32_t length = 0;
+  switch (input.kind) {
+  case BidiInput::STRING:
+    bidi_WriteString(input.value.As<String>(), dest, 0, input.length);
+    return input.length;
+  case BidiInput::UTF16:
+    std::memcpy(dest, input.data, input.length * sizeof(UChar));
+    return input.length;
+  case BidiInput::UTF16LE_BYTES:
+    for (int32_t i = 0; i < input.length; i++) {
+      dest[i] = (UChar) ((uint8_t) input.bytes[2*i] |
+                         ((uint8_t) input.bytes[2*i + 1] << 8));
+    }
+    return input.length;
+  case BidiInput::UTF8_BYTES:
+    // Like node, replace malformed UTF-8 with U+FFFD.
+    u_strFromUTF8WithSub(dest, input.length, &length,
+                         input.bytes, input.length, 0xFFFD, NULL,
+                         &errorCode);
+    return U_FAILURE(errorCode) ? 0 : length;
+  }
+  return 0;
+}
+
+/* The prologue and epilogue options are ignored if they aren't text. */
+static bool bidi_ParseContext(Local<Value> value, BidiEncoding encoding,
+                              BidiInput *input) {
+  return bidi_ParseInput(
+    (value->IsString() || value->IsArrayBufferView()) ?
+      value : (Local<Value>) Nan::EmptyString(),
+    encoding, input
+  );
+}
+
+static bool bidi_ParseEncoding(Local<Value> encoding,
+                               BidiEncoding *result) {
+  if (encoding->IsUndefined()) {
+    *result = BIDI_UTF8;
+    return true;
+  }
+  Nan::Utf8String name(encoding);
+  if (!std::strcmp(*name, "utf8") || !std::strcmp(*name, "utf-8")) {
+    *result = BIDI_UTF8;
+  } else if (!std::strcmp(*name, "utf16le") ||
+             !std::strcmp(*name, "utf-16le") ||
+             !std::strcmp(*name, "ucs2") || !std::strcmp(*name, "ucs-2")) {
+    *result = BIDI_UTF16LE;
+  } else {
+    Nan::ThrowTypeError("Unknown encoding");
+    return false;
+  }
+  return true;
+}
+
+bool bidi_ParseOptions(Local<Object> options, BidiOptions *opts) {
+  opts->paraLevel = (UBiDiLevel)
+    CAST_INT(GET_PROPERTY(options, "paraLevel"), UBIDI_DEFAULT_LTR);
+  if (!(opts->paraLevel <= UBIDI_MAX_EXPLICIT_LEVEL ||
+        opts->paraLevel == UBIDI_DEFAULT_LTR ||
+        opts->paraLevel == UBIDI_DEFAULT_RTL)) {
+    opts->paraLevel = UBIDI_DEFAULT_LTR;
+  }
+
+  opts->reorderingMode =
+    CAST_INT(GET_PROPERTY(options, "reorderingMode"), -1);
+  if (!(opts->reorderingMode >= 0 &&
+        opts->reorderingMode < UBIDI_REORDER_COUNT)) {
+    opts->reorderingMode = -1;
+  }
+
+  opts->reorderingOptions =
+    CAST_INT(GET_PROPERTY(options, "reorderingOptions"), -1);
+  if (!(opts->reorderingOptions >= 0 && opts->reorderingOptions <=
+        (UBIDI_OPTION_INSERT_MARKS | UBIDI_OPTION_REMOVE_CONTROLS |
+         UBIDI_OPTION_STREAMING))) {
+    opts->reorderingOptions = -1;
+  }
+
+  Local<Value> inverse =
+    GET_PROPERTY(options, "inverse");
+  opts->inverse = inverse->IsBoolean() ? CAST_BOOL(inverse, false) : -1;
+
+  Local<Value> reorderParagraphsLTR =
+    GET_PROPERTY(options, "reorderParagraphsLTR");
+  opts->orderParagraphsLTR = reorderParagraphsLTR->IsBoolean() ?
+    CAST_BOOL(reorderParagraphsLTR, false) : -1;
+
+  Local<Value> levels = GET_PROPERTY(options, "embeddingLevels");
+  opts->embeddingLevels = NULL;
+  opts->embeddingLevelsLength = 0;
+  if (levels->IsUint8Array()) {
+    Nan::TypedArrayContents<UBiDiLevel> contents(levels);
+    opts->embeddingLevels = *contents;
+    opts->embeddingLevelsLength = contents.length() > INT32_MAX ?
+      INT32_MAX : (int32_t) contents.length();
+  } else if (!(levels->IsUndefined() || levels->IsNull())) {
+    Nan::ThrowTypeError("embeddingLevels should be a Uint8Array");
+    return false;
+  }
+
+  return
+    bidi_ParseEncoding(GET_PROPERTY(options, "encoding"), &opts->encoding) &&
+    bidi_ParseContext(GET_PROPERTY(options, "prologue"), opts->encoding,
+                      &opts->prologue) &&
+    bidi_ParseContext(GET_PROPERTY(options, "epilogue"), opts->encoding,
+                      &opts->epilogue);
+}
+
+void bidi_ApplyOptions(UBiDi *para, const BidiOptions &opts) {
+  if (opts.reorderingMode >= 0) {
+    ubidi_setReorderingMode(para, (UBiDiReorderingMode) opts.reorderingMode);
+  }
+  if (opts.reorderingOptions >= 0) {
+    ubidi_setReorderingOptions(para, (uint32_t) opts.reorderingOptions);
+  }
+  if (opts.inverse >= 0) {
+    ubidi_setInverse(para, opts.inverse);
+  }
+  if (opts.orderParagraphsLTR >= 0) {
+    ubidi_orderParagraphsLTR(para, opts.orderParagraphsLTR);
+  }
+}
+
+int32_t bidi_ReorderedSize(UBiDi *para, uint16_t options,
+                           UErrorCode *errorCode) {
+  int32_t destSize = ubidi_getProcessedLength(para);
+  if (ubidi_getLength(para) > destSize) {
+    destSize = ubidi_getLength(para);
+  }
+  if (ubidi_getResultLength(para) > destSize) {
+    destSize = ubidi_getResultLength(para);
+  }
+  if (0 != (options & UBIDI_INSERT_LRM_FOR_NUMERIC)) {
+    destSize += 2 * ubidi_countRuns(para, errorCode);
+  }
+  return destSize;
+}
+
 #define CHECK_UBIDI_ERR(obj)                                        \
   do {                                                              \
     if (U_FAILURE((obj)->errorCode)) {                              \
@@ -48,40 +463,229 @@ static UBiDiDirection level2dir(UBiDiLevel level) {
     }                                                               \
   } while (false)
 
+#define REQUIRE_OPEN(obj)                                           \
+  do {                                                              \
+    if (!(obj)->IsOpen()) {                                         \
+      return Nan::ThrowError("Paragraph has been closed or reset"); \
+    }                                                               \
+  } while (false)
+
+// For methods which need a UBiDi, even if the text was trivial.
+#define REQUIRE_RESOLVED(obj)                                       \
+  do {                                                              \
+    REQUIRE_OPEN(obj);                                              \
+    if (!(obj)->Resolve()) {                                        \
+      CHECK_UBIDI_ERR(obj);                                         \
+      return Nan::ThrowError("libicu open failed");                 \
+    }                                                               \
+  } while (false)
+
+// For methods which need a UBiDi, unless the text was trivial.
+#define REQUIRE_RESOLVED_UNLESS_TRIVIAL(obj)                        \
+  do {                                                              \
+    REQUIRE_OPEN(obj);                                              \
+    if (!(obj)->trivial) { REQUIRE_RESOLVED(obj); }                 \
+  } while (false)
+
+// For methods which need the number of runs.
+#define REQUIRE_RUNS(obj)                                           \
+  do {                                                              \
+    if ((obj)->runs < 0) {                                          \
+      REQUIRE_RESOLVED(obj);                                        \
+      (obj)->runs = ubidi_countRuns((obj)->para, &(obj)->errorCode); \
+      CHECK_UBIDI_ERR(obj);                                         \
+    }                                                               \
+  } while (false)
+
+// Reordered text up to this many code units is built on the stack.
+#define BIDI_STACK_BUFFER 1024
+
+/* The output of ubidi_writeReordered(), which lives on the stack if it
+ * is short and on the heap otherwise.  It can be given room for more
+ * than one copy of the text, so that a second pass (such as shaping)
+ * can write its result into the same buffer. */
+class ReorderedText {
+public:
+  explicit ReorderedText(int copies = 1) :
+    data(NULL), length(0), copies(copies), buffer(NULL), capacity(0),
+    heap(NULL) {}
+  ~ReorderedText() { delete[] heap; }
+  UChar *Allocate(int32_t size) {
+    return Reserve(size * copies);
+  }
+  /* Room for `size` code units which doesn't overlap `data`. */
+  UChar *Spare(int32_t size) {
+    if (buffer == NULL || data != buffer) {
+      return Reserve(size);
+    }
+    if (capacity - length < size) {
+      // Only unshaping can outgrow the room we made, so this is rare.
+      UChar *grown = new UChar[length + size];
+      std::memcpy(grown, data, length * sizeof(UChar));
+      delete[] heap;
+      data = buffer = heap = grown;
+      capacity = length + size;
+    }
+    return buffer + length;
+  }
+  const UChar *data;
+  int32_t length;
+private:
+  UChar *Reserve(int32_t size) {
+    capacity = size > BIDI_STACK_BUFFER ? size : BIDI_STACK_BUFFER;
+    if (size <= BIDI_STACK_BUFFER) { return buffer = stack; }
+    delete[] heap;
+    heap = new UChar[size];
+    return buffer = heap;
+  }
+  int copies;
+  UChar *buffer;
+  int32_t capacity;
+  UChar stack[BIDI_STACK_BUFFER];
+  UChar *heap;
+};
+
 // declarations
 class Paragraph : public Nan::ObjectWrap {
 public:
-  static Nan::Persistent<FunctionTemplate> constructor_template;
-  static void Init(Nan::ADDON_REGISTER_FUNCTION_ARGS_TYPE target);
+  static void Init(Nan::ADDON_REGISTER_FUNCTION_ARGS_TYPE target,
+                   BidiAddon *addon);
 protected:
-  Paragraph() : Nan::ObjectWrap(),
+  explicit Paragraph(BidiAddon *addon, bool isLine = false) :
+                Nan::ObjectWrap(),
+                addon(addon),
                 para(NULL),
                 text(NULL),
+                maxLength(0),
+                textCapacity(0),
                 runs(-1),
-                errorCode(U_ZERO_ERROR)  {
+                pending(false),
+                trivial(false),
+                errorCode(U_ZERO_ERROR),
+                generation(0),
+                parentPara(NULL),
+                parentGeneration(0),
+                isLine(isLine),
+                nativeBytes(0),
+                shared(NULL)  {
+    bidi_AddonRef(addon);
+    if (isLine) {
+      addon->stats.linesCreated++;
+      addon->stats.linesLive++;
+    } else {
+      addon->stats.paragraphsCreated++;
+      addon->stats.paragraphsLive++;
+    }
   }
   ~Paragraph() {
+    Free();
+    parent.Reset();
+    if (isLine) {
+      addon->stats.linesLive--;
+    } else {
+      addon->stats.paragraphsLive--;
+    }
+    bidi_AddonUnref(addon);
+  }
+
+  // Lines borrow memory from their parent paragraph, so they become
+  // invalid once the parent is reset or closed.
+  bool IsOpen() const {
+    return (para != NULL || pending) &&
+      (parentPara == NULL || parentPara->generation == parentGeneration);
+  }
+  void Free() {
+    Detach();
     if (para != NULL) {
       ubidi_close(para);
       para = NULL;
     }
     if (text != NULL) {
-      delete text;
+      delete[] text;
       text = NULL;
     }
-    parent.Reset();
+    maxLength = textCapacity = 0;
+    pending = trivial = false;
+    pinned.Reset();
+#ifdef BIDI_HAVE_BACKING_STORE
+    stores.clear();
+#endif
+    std::vector<UBiDiLevel>().swap(embeddingLevels);
+    generation++;
+    UpdateNativeBytes();
+  }
+  // Let go of a cache entry we were sharing.
+  void Detach() {
+    if (shared != NULL) {
+      bidi_CacheRelease(addon, shared);
+      shared = NULL;
+      para = NULL;
+    }
+  }
+  // Tell the stats and V8 how much memory we're holding on to.  (A
+  // shared cache entry is accounted for by the cache.)
+  void UpdateNativeBytes() {
+    int64_t bytes = (int64_t) textCapacity * sizeof(UChar) +
+      (int64_t) embeddingLevels.capacity() +
+      (para == NULL || shared != NULL ? 0 : BIDI_UBIDI_SIZE(maxLength));
+    bidi_AdjustNativeBytes(addon, bytes - nativeBytes);
+    nativeBytes = bytes;
+  }
+  static bool ParseArguments(Nan::NAN_METHOD_ARGS_TYPE info,
+                             BidiInput *text, BidiOptions *opts);
+  void SetPara(const BidiInput &str, const BidiOptions &opts);
+  bool Resolve();
+  bool Run();
+  bool UseCache();
+  bool IsTrivialReorder(uint16_t options) const {
+    // Mirroring and combining marks only matter in RTL runs.
+    return trivial &&
+      0 == (options & ~(UBIDI_DO_MIRRORING | UBIDI_KEEP_BASE_COMBINING));
+  }
+  bool Reorder(uint16_t options, ReorderedText *out);
+  // Lengths which can be answered before resolving: the processed and
+  // result lengths only differ from the length with certain options.
+  bool ProcessedLengthKnown() const {
+    return pending && (options.reorderingOptions <= 0 ||
+      0 == (options.reorderingOptions & UBIDI_OPTION_STREAMING));
+  }
+  bool ResultLengthKnown() const {
+    return ProcessedLengthKnown() && (options.reorderingOptions <= 0 ||
+      0 == (options.reorderingOptions &
+            (UBIDI_OPTION_INSERT_MARKS | UBIDI_OPTION_REMOVE_CONTROLS)));
   }
 
   static NAN_METHOD(New);
+  static NAN_METHOD(Reset);
+  static NAN_METHOD(Close);
 
   static NAN_METHOD(GetDirection);
   static NAN_METHOD(GetParaLevel);
   static NAN_METHOD(GetLevelAt);
+  static NAN_METHOD(GetLevels);
   static NAN_METHOD(GetLength);
+#ifdef BIDI_FAST_API
+  // Fast versions of the integer accessors, which leave anything that
+  // could throw or run the bidi algorithm to the slow versions.
+  static Paragraph *FastUnwrap(Local<Object> receiver, bool resolved,
+                               FastApiCallbackOptions &options);
+  static int32_t FastGetLength(Local<Object> receiver,
+                               FastApiCallbackOptions &options);
+  static int32_t FastGetLevelAt(Local<Object> receiver, int32_t charIndex,
+                                FastApiCallbackOptions &options);
+  static int32_t FastGetVisualIndex(Local<Object> receiver,
+                                    int32_t logicalIndex,
+                                    FastApiCallbackOptions &options);
+  static int32_t FastGetLogicalIndex(Local<Object> receiver,
+                                     int32_t visualIndex,
+                                     FastApiCallbackOptions &options);
+#endif
   static NAN_METHOD(GetProcessedLength);
   static NAN_METHOD(GetResultLength);
   static NAN_METHOD(GetVisualIndex);
   static NAN_METHOD(GetLogicalIndex);
+  static NAN_METHOD(GetVisualMap);
+  static NAN_METHOD(GetLogicalMap);
 
   static NAN_METHOD(CountParagraphs);
   static NAN_METHOD(GetParagraph);
@@ -90,28 +694,66 @@ protected:
   static NAN_METHOD(CountRuns);
   static NAN_METHOD(GetVisualRun);
   static NAN_METHOD(GetLogicalRun);
+  static NAN_METHOD(GetRuns);
+  static NAN_METHOD(GetLogicalRuns);
+  static NAN_METHOD(LogicalRangesToVisual);
+  static NAN_METHOD(VisualRangesToLogical);
 
   static NAN_METHOD(SetLine);
+  static NAN_METHOD(LayoutLines);
   static NAN_METHOD(WriteReordered);
+  static NAN_METHOD(WriteReorderedInto);
+  static NAN_METHOD(WriteReorderedUtf8);
+  static NAN_METHOD(ShapeAndReorder);
 
 protected:
+  BidiAddon *addon;
   UBiDi *para;
   UChar *text;
+  int32_t maxLength, textCapacity;
   int32_t runs;
+  // true if ICU hasn't been given the text passed to SetPara (yet).
+  bool pending;
+  // true if the text is known to be a single LTR run at level 0, so
+  // most questions can be answered without ICU.
+  bool trivial;
+  // the (prologue, text, epilogue) and options passed to SetPara.
+  const UChar *start[3];
+  int32_t length[3];
+  BidiOptions options;
   UErrorCode errorCode;
+  // incremented whenever para is reset or closed.
+  uint32_t generation;
+  Paragraph *parentPara;
+  uint32_t parentGeneration;
   // keep a pointer to the parent paragraph to ensure that lines are
   // gc'ed/destroyed before the paragraph they belong to.
   Nan::Persistent<Object> parent;
+  // typed arrays whose memory we are using in place.
+  Nan::Persistent<Object> pinned;
+  // our copy of the embeddingLevels option.
+  std::vector<UBiDiLevel> embeddingLevels;
+#ifdef BIDI_HAVE_BACKING_STORE
+  // and our share of that memory, which stays valid even if the arrays
+  // are detached.
+  std::vector<std::shared_ptr<BackingStore> > stores;
+#endif
+  bool isLine;
+  // the memory we've reported to the stats.
+  int64_t nativeBytes;
+  // the cache entry whose UBiDi we're using as `para`, if any.
+  BidiCacheEntry *shared;
 };
 
 // implementation
-Nan::Persistent<FunctionTemplate> Paragraph::constructor_template;
-
-void Paragraph::Init(Nan::ADDON_REGISTER_FUNCTION_ARGS_TYPE target) {
+void Paragraph::Init(Nan::ADDON_REGISTER_FUNCTION_ARGS_TYPE target,
+                     BidiAddon *addon) {
   const char *CLASS_NAME = "Paragraph";
   Nan::HandleScope scope;
 
-  Local<FunctionTemplate> t = Nan::New<FunctionTemplate>(New);
+  Local<FunctionTemplate> t = Nan::New<FunctionTemplate>(
+    New, Nan::New<External>(addon)
+  );
 
   t->InstanceTemplate()->SetInternalFieldCount(1);
   t->SetClassName(NEW_STR(CLASS_NAME));
@@ -119,26 +761,62 @@ void Paragraph::Init(Nan::ADDON_REGISTER_FUNCTION_ARGS_TYPE target) {
   bidi_SetPrototypeMethod(t, "countRuns", CountRuns);
   bidi_SetPrototypeMethod(t, "getVisualRun", GetVisualRun);
   bidi_SetPrototypeMethod(t, "getLogicalRun", GetLogicalRun);
+  bidi_SetPrototypeMethod(t, "getRuns", GetRuns);
+  bidi_SetPrototypeMethod(t, "getLogicalRuns", GetLogicalRuns);
+  bidi_SetPrototypeMethod(t, "logicalRangesToVisual", LogicalRangesToVisual);
+  bidi_SetPrototypeMethod(t, "visualRangesToLogical", VisualRangesToLogical);
 
   bidi_SetPrototypeMethod(t, "getDirection", GetDirection);
   bidi_SetPrototypeMethod(t, "getParaLevel", GetParaLevel);
+#ifdef BIDI_FAST_API
+  static const CFunction fastGetLevelAt = CFunction::Make(FastGetLevelAt);
+  bidi_SetFastPrototypeMethod<GetLevelAt>(t, "getLevelAt", &fastGetLevelAt);
+#else
   bidi_SetPrototypeMethod(t, "getLevelAt", GetLevelAt);
+#endif
+  bidi_SetPrototypeMethod(t, "getLevels", GetLevels);
+#ifdef BIDI_FAST_API
+  static const CFunction fastGetLength = CFunction::Make(FastGetLength);
+  bidi_SetFastPrototypeMethod<GetLength>(t, "getLength", &fastGetLength);
+#else
   bidi_SetPrototypeMethod(t, "getLength", GetLength);
+#endif
   bidi_SetPrototypeMethod(t, "getProcessedLength", GetProcessedLength);
   bidi_SetPrototypeMethod(t, "getResultLength", GetResultLength);
 
+#ifdef BIDI_FAST_API
+  static const CFunction fastGetVisualIndex =
+    CFunction::Make(FastGetVisualIndex);
+  static const CFunction fastGetLogicalIndex =
+    CFunction::Make(FastGetLogicalIndex);
+  bidi_SetFastPrototypeMethod<GetVisualIndex>(t, "getVisualIndex",
+                                              &fastGetVisualIndex);
+  bidi_SetFastPrototypeMethod<GetLogicalIndex>(t, "getLogicalIndex",
+                                               &fastGetLogicalIndex);
+#else
   bidi_SetPrototypeMethod(t, "getVisualIndex", GetVisualIndex);
   bidi_SetPrototypeMethod(t, "getLogicalIndex", GetLogicalIndex);
+#endif
+  bidi_SetPrototypeMethod(t, "getVisualMap", GetVisualMap);
+  bidi_SetPrototypeMethod(t, "getLogicalMap", GetLogicalMap);
 
   bidi_SetPrototypeMethod(t, "countParagraphs", CountParagraphs);
   bidi_SetPrototypeMethod(t, "getParagraph", GetParagraph);
   bidi_SetPrototypeMethod(t, "getParagraphByIndex", GetParagraphByIndex);
 
   bidi_SetPrototypeMethod(t, "setLine", SetLine);
+  bidi_SetPrototypeMethod(t, "layoutLines", LayoutLines);
 
   bidi_SetPrototypeMethod(t, "writeReordered", WriteReordered);
+  bidi_SetPrototypeMethod(t, "writeReorderedInto", WriteReorderedInto);
+  bidi_SetPrototypeMethod(t, "writeReorderedUtf8", WriteReorderedUtf8);
+  bidi_SetPrototypeMethod(t, "shapeAndReorder", ShapeAndReorder);
 
-  constructor_template.Reset(t);
+  bidi_SetPrototypeMethod(t, "reset", Reset);
+  bidi_SetPrototypeMethod(t, "close", Close);
+  bidi_SetPrototypeMethod(t, "dispose", Close);
+
+  addon->paragraphTemplate.Reset(t);
   Nan::Set(target, NEW_STR(CLASS_NAME), Nan::GetFunction(t).ToLocalChecked());
 }
 
@@ -152,7 +830,9 @@ NAN_METHOD(Paragraph::New) {
     for (int i=0; i<argc; i++) { argv[i] = info[i]; }
     Nan::TryCatch try_catch;
     Nan::MaybeLocal<Object> result = Nan::NewInstance(
-      Nan::GetFunction(Nan::New<FunctionTemplate>(constructor_template))
+      Nan::GetFunction(Nan::New<FunctionTemplate>(
+        bidi_GetAddon(info.Data())->paragraphTemplate
+      ))
       .ToLocalChecked(), argc, argv);
     delete[] argv;
     if (try_catch.HasCaught()) {
@@ -171,17 +851,29 @@ NAN_METHOD(Paragraph::New) {
     info.GetReturnValue().Set(info.This());
     return;
   }
+  BidiTraceScope trace("Paragraph");
 
-  Nan::MaybeLocal<String> maybeText = Nan::To<String>(info[0]);
-  if (maybeText.IsEmpty()) {
-    // conversion failed.  toString() threw an exception?
-    return Nan::ThrowTypeError(
-        "First argument couldn't be converted to a string"
-    );
+  BidiInput text;
+  BidiOptions opts;
+  if (!ParseArguments(info, &text, &opts)) {
+    return;
   }
-  Local<String> text = maybeText.ToLocalChecked();
-  int32_t tlen = text->Length();
 
+  Paragraph *para = new Paragraph(bidi_GetAddon(info.Data()));
+  para->Wrap(info.This());
+
+  para->SetPara(text, opts);
+  CHECK_UBIDI_ERR(para);
+  if (!para->IsOpen()) {
+    return Nan::ThrowError("libicu open failed");
+  }
+
+  info.GetReturnValue().Set(info.This());
+}
+
+/* Parse the (text, [options]) arguments of the constructor and reset(). */
+bool Paragraph::ParseArguments(Nan::NAN_METHOD_ARGS_TYPE info,
+                               BidiInput *text, BidiOptions *opts) {
   // an optional options hash for the second argument.
   Local<Object> options;
   if (info.Length() <= 1) {
@@ -189,91 +881,225 @@ NAN_METHOD(Paragraph::New) {
   } else {
     Nan::MaybeLocal<Object> maybeOptions = Nan::To<Object>(info[1]);
     if (maybeOptions.IsEmpty()) {
-      return Nan::ThrowTypeError(
-        "Second argument should be an options hash"
-      );
+      Nan::ThrowTypeError("Second argument should be an options hash");
+      return false;
     }
     options = maybeOptions.ToLocalChecked();
   }
+  if (!bidi_ParseOptions(options, opts)) {
+    return false;
+  }
 
-  Paragraph *para = new Paragraph();
-  para->Wrap(info.This());
+  // Typed arrays and buffers are used as is; anything else is converted
+  // to a string.
+  Local<Value> value = info[0];
+  if (!value->IsArrayBufferView()) {
+    Nan::MaybeLocal<String> maybeText = Nan::To<String>(value);
+    if (maybeText.IsEmpty()) {
+      // conversion failed.  toString() threw an exception?
+      Nan::ThrowTypeError("First argument couldn't be converted to a string");
+      return false;
+    }
+    value = maybeText.ToLocalChecked();
+  }
+  return bidi_ParseInput(value, opts->encoding, text);
+}
 
-  para->para = ubidi_openSized(tlen, 0, &para->errorCode);
-  CHECK_UBIDI_ERR(para);
-  if (para->para==NULL) {
-    return Nan::ThrowError("libicu open failed");
+void Paragraph::SetPara(const BidiInput &str, const BidiOptions &opts) {
+  const BidiInput *inputs[3] = { &opts.prologue, &str, &opts.epilogue };
+  Detach();
+
+  // Copy (or convert) whatever we can't use in place into our own buffer,
+  // and keep it alive as long as we're alive.  The buffer is only
+  // reallocated if it must grow.
+  int32_t needed = 0;
+  for (int i = 0; i < 3; i++) {
+    if (!inputs[i]->IsBorrowed()) { needed += inputs[i]->length; }
+  }
+  if (text == NULL || needed > textCapacity) {
+    delete[] text;
+    textCapacity = needed;
+    text = new UChar[textCapacity];
+    UpdateNativeBytes();
+  }
+  UChar *dest = text;
+  Local<Array> borrowed = Nan::New<Array>();
+#ifdef BIDI_HAVE_BACKING_STORE
+  stores.clear();
+#endif
+  for (int i = 0; i < 3; i++) {
+    if (inputs[i]->IsBorrowed()) {
+      start[i] = inputs[i]->data;
+      length[i] = inputs[i]->length;
+      Nan::Set(borrowed, borrowed->Length(), inputs[i]->value);
+#ifdef BIDI_HAVE_BACKING_STORE
+      stores.push_back(
+        inputs[i]->value.As<ArrayBufferView>()->Buffer()->GetBackingStore()
+      );
+#endif
+    } else {
+      start[i] = dest;
+      length[i] = bidi_CopyInput(*inputs[i], dest);
+      dest += length[i];
+    }
+    // ICU won't accept NULL, even for empty text.
+    if (start[i] == NULL) { start[i] = text; }
+  }
+  // Typed arrays we use in place have to stay alive as long as we do.
+  if (borrowed->Length() > 0) {
+    pinned.Reset(borrowed);
+  } else {
+    pinned.Reset();
+  }
+  options = opts;
+  options.prologue.value.Clear();
+  options.epilogue.value.Clear();
+  // ICU keeps (and writes to) the explicit levels, so they must belong to
+  // us rather than to an array which could be detached or reused.
+  if (opts.embeddingLevels != NULL) {
+    embeddingLevels.resize(opts.embeddingLevelsLength > 0 ?
+                           opts.embeddingLevelsLength : 1);
+    std::memcpy(&embeddingLevels[0], opts.embeddingLevels,
+                opts.embeddingLevelsLength);
+    options.embeddingLevels = &embeddingLevels[0];
+  } else {
+    std::vector<UBiDiLevel>().swap(embeddingLevels);
+  }
+  UpdateNativeBytes();
+
+  // any lines taken from the old text are now invalid.
+  generation++;
+  addon->stats.bytesProcessed += length[1] * sizeof(UChar);
+
+  // Don't run the bidi algorithm until someone asks for something which
+  // needs it: lengths and the paragraph level usually don't.  Most text
+  // is plain LTR, and then hardly anything does.
+  pending = true;
+  trivial = length[1] > 0 && bidi_IsDefaultLTR(opts) &&
+    bidi_IsSimpleLTR(start[1], length[1]);
+  runs = trivial ? 1 : -1;
+
+  // But report bad arguments now, as ICU would have.
+  if ((opts.paraLevel > UBIDI_MAX_EXPLICIT_LEVEL &&
+       opts.paraLevel < UBIDI_DEFAULT_LTR) ||
+      // ICU reads (and may write) one level for each character.
+      (opts.embeddingLevels != NULL &&
+       opts.embeddingLevelsLength < length[1])) {
+    errorCode = U_ILLEGAL_ARGUMENT_ERROR;
   }
 
-  // parse values from the options hash
-  UBiDiLevel paraLevel = (UBiDiLevel)
-    CAST_INT(GET_PROPERTY(options, "paraLevel"), UBIDI_DEFAULT_LTR);
-  if (!(paraLevel <= UBIDI_MAX_EXPLICIT_LEVEL ||
-        paraLevel == UBIDI_DEFAULT_LTR ||
-        paraLevel == UBIDI_DEFAULT_RTL)) {
-    paraLevel = UBIDI_DEFAULT_LTR;
+  // Text we use in place could change before we get round to it, and
+  // `trivial` describes it as it is now, so resolve it straight away.
+  if (borrowed->Length() > 0) {
+    Resolve();
   }
+}
 
-  UBiDiReorderingMode reorderingMode = (UBiDiReorderingMode)
-    CAST_INT(GET_PROPERTY(options, "reorderingMode"), UBIDI_REORDER_COUNT);
-  if (reorderingMode >= 0 && reorderingMode < UBIDI_REORDER_COUNT) {
-    ubidi_setReorderingMode(para->para, reorderingMode);
+/* Share the resolved paragraph from the cache, rather than running the
+ * bidi algorithm ourselves.  Returns false if ICU failed. */
+bool Paragraph::UseCache() {
+  BidiCacheEntry *entry =
+    bidi_CacheGet(addon, start, length, options, &errorCode);
+  if (entry == NULL) {
+    return false;
+  }
+  if (para != NULL) {
+    ubidi_close(para);
   }
+  shared = entry;
+  para = entry->para;
+  maxLength = 0;
+  for (int i = 0; i < 3; i++) {
+    start[i] = entry->start[i];
+  }
+  UpdateNativeBytes();
+  return true;
+}
 
-  int32_t reorderingOptions =
-    CAST_INT(GET_PROPERTY(options, "reorderingOptions"), -1);
-  if (reorderingOptions >= 0 && reorderingOptions <=
-      (UBIDI_OPTION_INSERT_MARKS | UBIDI_OPTION_REMOVE_CONTROLS |
-       UBIDI_OPTION_STREAMING)) {
-    ubidi_setReorderingOptions(para->para, (uint32_t) reorderingOptions);
+/* Run the bidi algorithm on the text given to SetPara, if we haven't
+ * already.  Returns false if ICU failed. */
+bool Paragraph::Resolve() {
+  if (!pending) {
+    return U_SUCCESS(errorCode);
+  }
+  pending = false;
+  if (U_FAILURE(errorCode)) {
+    return false;
+  }
+  if (!trivial && addon->cache.size > 0 && options.embeddingLevels == NULL) {
+    return UseCache();
   }
+  return Run();
+}
 
-  Local<Value> inverse =
-    GET_PROPERTY(options, "inverse");
-  if (inverse->IsBoolean()) {
-    ubidi_setInverse(para->para, CAST_BOOL(inverse, false));
+bool Paragraph::Run() {
+  int32_t plen = length[0], tlen = length[1], elen = length[2];
+  bool reused = (para != NULL);
+
+  // A UBiDi opened with a nonzero maxLength can't grow, so replace it if
+  // the new text is too long.
+  if (reused && maxLength != 0 && tlen > maxLength) {
+    ubidi_close(para);
+    para = NULL;
+    reused = false;
+  }
+  if (para == NULL) {
+    para = ubidi_openSized(tlen, 0, &errorCode);
+    maxLength = tlen;
+    UpdateNativeBytes();
+    if (U_FAILURE(errorCode) || para == NULL) { return false; }
+  } else {
+    // Return a reused object to its default settings.
+    ubidi_setReorderingMode(para, UBIDI_REORDER_DEFAULT);
+    ubidi_setReorderingOptions(para, UBIDI_OPTION_DEFAULT);
+    ubidi_orderParagraphsLTR(para, false);
   }
+  bidi_ApplyOptions(para, options);
 
-  Local<Value> reorderParagraphsLTR =
-    GET_PROPERTY(options, "reorderParagraphsLTR");
-  if (reorderParagraphsLTR->IsBoolean()) {
-    ubidi_orderParagraphsLTR(para->para, CAST_BOOL(reorderParagraphsLTR, false));
-  }
-
-  Local<String> prologue =
-    CAST_STRING(GET_PROPERTY(options, "prologue"), Nan::EmptyString());
-  Local<String> epilogue =
-    CAST_STRING(GET_PROPERTY(options, "epilogue"), Nan::EmptyString());
-  int32_t plen = prologue->Length();
-  int32_t elen = epilogue->Length();
-
-  // Copy main, prologue, and epilogue text and keep it alive as long
-  // as we're alive.
-  para->text = new UChar[plen + tlen + elen];
-  prologue->Write(para->text, 0, plen);
-  text->Write(para->text + plen, 0, tlen);
-  epilogue->Write(para->text + plen + tlen, 0, elen);
-  if (plen!=0 || elen!=0) {
+  if (plen!=0 || elen!=0 || reused) {
     ubidi_setContext(
-      para->para, para->text, plen,
-      para->text + plen + tlen, elen,
-      &para->errorCode
+      para, start[0], plen,
+      start[2], elen,
+      &errorCode
     );
-    CHECK_UBIDI_ERR(para);
+    if (U_FAILURE(errorCode)) { return false; }
   }
 
-  // XXX parse options.embeddingLevels and construct an appropriate array of
-  //     UBiDiLevel to pass to setPara
+  BIDI_TIMED(addon->stats, setPara, ubidi_setPara(
+    para, start[1], tlen, options.paraLevel, options.embeddingLevels,
+    &errorCode
+  ));
+  return U_SUCCESS(errorCode);
+}
+
+NAN_METHOD(Paragraph::Reset) {
+  BidiTraceScope trace("Paragraph#reset");
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  if (!para->parent.IsEmpty()) {
+    return Nan::ThrowTypeError("Lines can not be reset");
+  }
+  REQUIRE_ARGUMENTS(1);
+  BidiInput text;
+  BidiOptions opts;
+  if (!ParseArguments(info, &text, &opts)) {
+    return;
+  }
 
-  ubidi_setPara(para->para, para->text + plen, tlen,
-                paraLevel, NULL, &para->errorCode);
+  para->errorCode = U_ZERO_ERROR;
+  para->SetPara(text, opts);
   CHECK_UBIDI_ERR(para);
+  info.GetReturnValue().Set(info.Holder());
+}
 
-  info.GetReturnValue().Set(info.This());
+NAN_METHOD(Paragraph::Close) {
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  para->Free();
 }
 
 NAN_METHOD(Paragraph::SetLine) {
+  BidiTraceScope trace("Paragraph#setLine");
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_RESOLVED(para);
   if (!para->parent.IsEmpty()) {
     return Nan::ThrowTypeError("This is already a line");
   }
@@ -283,8 +1109,11 @@ NAN_METHOD(Paragraph::SetLine) {
   int32_t limit = Nan::To<int32_t>(info[1]).FromJust();
 
   // Create para object.
-  Paragraph *line = new Paragraph();
-  line->para = ubidi_openSized(ubidi_getLength(para->para), 0, &line->errorCode);
+  Paragraph *line = new Paragraph(para->addon, true);
+  // A line only needs room for its own text.
+  line->maxLength = limit > start ? limit - start : 0;
+  line->para = ubidi_openSized(line->maxLength, 0, &line->errorCode);
+  line->UpdateNativeBytes();
   if (U_FAILURE(line->errorCode) || line->para==NULL) {
     delete line;
     return Nan::ThrowError("libicu open failed");
@@ -301,52 +1130,240 @@ NAN_METHOD(Paragraph::SetLine) {
   // by passing it as an External
   Local<Value> consArgs[1] = { Nan::New<External>(line) };
   Local<Object> lineObj = Nan::NewInstance(
-    Nan::GetFunction(Nan::New(constructor_template)).ToLocalChecked(),
+    Nan::GetFunction(Nan::New(para->addon->paragraphTemplate))
+    .ToLocalChecked(),
     1, consArgs).ToLocalChecked();
   line->parent.Reset(info.Holder());
+  line->parentPara = para;
+  line->parentGeneration = para->generation;
   info.GetReturnValue().Set(lineObj);
 }
 
+/* layoutLines(breaks, [options]): reorder every line of the paragraph at
+ * once.  `breaks` is an Int32Array of the offsets at which lines start
+ * (other than the first); a single line object is reused for all the
+ * lines. */
+NAN_METHOD(Paragraph::LayoutLines) {
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_OPEN(para);
+  if (!para->parent.IsEmpty()) {
+    return Nan::ThrowTypeError("This is already a line");
+  }
+  if (info.Length() < 1 || !info[0]->IsInt32Array()) {
+    return Nan::ThrowTypeError("Argument 0 must be an Int32Array");
+  }
+  uint16_t options = 0;
+  if (info.Length() > 1) {
+    REQUIRE_ARGUMENT_NUMBER(1);
+    options = (uint16_t) Nan::To<uint32_t>(info[1]).FromJust();
+  }
+  if (!para->IsTrivialReorder(options)) {
+    REQUIRE_RESOLVED(para);
+  }
+  Nan::TypedArrayContents<int32_t> breaks(info[0]);
+  int32_t length = para->trivial ? para->length[1] :
+    ubidi_getProcessedLength(para->para);
+  int32_t count = (int32_t) breaks.length();
+  // Find the lines, and the longest one.
+  std::vector<int32_t> starts;
+  starts.reserve(count + 2);
+  starts.push_back(0);
+  int32_t maxLength = 0;
+  for (int32_t i = 0; i < count; i++) {
+    int32_t offset = (*breaks)[i];
+    if (!(offset >= starts.back() && offset <= length)) {
+      return Nan::ThrowRangeError("Line breaks must be in order and within the text");
+    }
+    if (offset - starts.back() > maxLength) {
+      maxLength = offset - starts.back();
+    }
+    starts.push_back(offset);
+  }
+  if (starts.back() < length || starts.size() == 1) {
+    if (length - starts.back() > maxLength) {
+      maxLength = length - starts.back();
+    }
+    starts.push_back(length);
+  }
+  int32_t lines = (int32_t) starts.size() - 1;
+
+  // Errors here don't affect the paragraph itself.
+  UErrorCode errorCode = U_ZERO_ERROR;
+  UBiDi *line = NULL;
+  if (!para->IsTrivialReorder(options)) {
+    line = ubidi_openSized(maxLength, 0, &errorCode);
+    if (U_FAILURE(errorCode) || line == NULL) {
+      return Nan::ThrowError("libicu open failed");
+    }
+  }
+
+  Local<Array> text = Nan::New<Array>(lines);
+  // (logicalStart, length, level) triples, relative to the paragraph,
+  // for every line in turn; runIndex[i] is the first run of line i.
+  std::vector<int32_t> runs;
+  Local<Object> runIndex;
+  int32_t *index = NULL;
+  bidi_OutputArray<Int32Array>(Nan::Undefined(), &Value::IsInt32Array,
+                               lines + 1, &runIndex, &index);
+  for (int32_t i = 0; i < lines; i++) {
+    int32_t start = starts[i], limit = starts[i + 1];
+    index[i] = (int32_t) runs.size() / 3;
+    if (start == limit) {
+      Nan::Set(text, i, Nan::EmptyString());
+      continue;
+    }
+    if (line == NULL) {
+      // Plain LTR text: each line is a single run.
+      Nan::Set(text, i, Nan::New<String>(
+        para->start[1] + start, limit - start
+      ).ToLocalChecked());
+      runs.push_back(start);
+      runs.push_back(limit - start);
+      runs.push_back(0);
+      continue;
+    }
+    ubidi_setLine(para->para, start, limit, line, &errorCode);
+    int32_t n = ubidi_countRuns(line, &errorCode);
+    int32_t destSize = bidi_ReorderedSize(line, options, &errorCode);
+    if (U_FAILURE(errorCode)) { break; }
+    ReorderedText result;
+    UChar *dest = result.Allocate(destSize);
+    BIDI_TIMED(para->addon->stats, writeReordered, result.length =
+      ubidi_writeReordered(line, dest, destSize, options, &errorCode));
+    if (U_FAILURE(errorCode)) { break; }
+    Nan::Set(text, i, Nan::New<String>(dest, result.length).ToLocalChecked());
+    for (int32_t j = 0; j < n; j++) {
+      int32_t logicalStart, runLength;
+      ubidi_getVisualRun(line, j, &logicalStart, &runLength);
+      runs.push_back(start + logicalStart);
+      runs.push_back(runLength);
+      runs.push_back(ubidi_getLevelAt(line, logicalStart));
+    }
+  }
+  if (line != NULL) {
+    ubidi_close(line);
+  }
+  if (U_FAILURE(errorCode)) {
+    return Nan::ThrowError(bidi_MakeError(errorCode));
+  }
+  index[lines] = (int32_t) runs.size() / 3;
+
+  Local<Object> runArray;
+  int32_t *dest = NULL;
+  bidi_OutputArray<Int32Array>(Nan::Undefined(), &Value::IsInt32Array,
+                               (int32_t) runs.size(), &runArray, &dest);
+  if (!runs.empty()) {
+    std::memcpy(dest, &runs[0], runs.size() * sizeof(int32_t));
+  }
+  Local<Object> result = Nan::New<Object>();
+  Nan::Set(result, NEW_STR("text"), text);
+  Nan::Set(result, NEW_STR("runs"), runArray);
+  Nan::Set(result, NEW_STR("runIndex"), runIndex);
+  info.GetReturnValue().Set(result);
+}
+
 NAN_METHOD(Paragraph::GetParaLevel) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_OPEN(para);
+  if (para->trivial) {
+    return info.GetReturnValue().Set(Nan::New(0));
+  }
+  // The first strong character decides, unless a prologue might.
+  if (para->pending && U_SUCCESS(para->errorCode) &&
+      (para->options.paraLevel <= UBIDI_MAX_EXPLICIT_LEVEL ||
+       para->length[0] == 0)) {
+    return info.GetReturnValue().Set(Nan::New(bidi_FirstParaLevel(
+      para->start[1], para->length[1], para->options.paraLevel
+    )));
+  }
+  REQUIRE_RESOLVED(para);
   info.GetReturnValue().Set(Nan::New(ubidi_getParaLevel(para->para)));
 }
 
 NAN_METHOD(Paragraph::GetLevelAt) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_RESOLVED_UNLESS_TRIVIAL(para);
   REQUIRE_ARGUMENT_NUMBER(0);
   int32_t charIndex = Nan::To<int32_t>(info[0]).FromJust();
+  if (para->trivial) {
+    return info.GetReturnValue().Set(Nan::New(0));
+  }
   info.GetReturnValue().Set(Nan::New(ubidi_getLevelAt(para->para, charIndex)));
 }
 
+NAN_METHOD(Paragraph::GetLevels) {
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_RESOLVED_UNLESS_TRIVIAL(para);
+  int32_t length = para->trivial ? para->length[1] :
+    ubidi_getProcessedLength(para->para);
+  Local<Object> result;
+  UBiDiLevel *dest;
+  if (!bidi_OutputArray<Uint8Array>(
+        info.Length() > 0 ? info[0] : (Local<Value>) Nan::Undefined(),
+        &Value::IsUint8Array, length, &result, &dest)) {
+    return;
+  }
+  // ubidi_getLevels rejects empty text, so only ask for non-empty input.
+  if (para->trivial) {
+    std::memset(dest, 0, length * sizeof(UBiDiLevel));
+  } else if (length > 0) {
+    const UBiDiLevel *levels = ubidi_getLevels(para->para, &para->errorCode);
+    CHECK_UBIDI_ERR(para);
+    std::memcpy(dest, levels, length * sizeof(UBiDiLevel));
+  }
+  info.GetReturnValue().Set(result);
+}
+
 NAN_METHOD(Paragraph::CountParagraphs) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_RESOLVED_UNLESS_TRIVIAL(para);
+  if (para->trivial) {
+    return info.GetReturnValue().Set(Nan::New(1));
+  }
   info.GetReturnValue().Set(Nan::New(ubidi_countParagraphs(para->para)));
 }
 
 NAN_METHOD(Paragraph::GetDirection) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
-  UBiDiDirection dir = ubidi_getDirection(para->para);
-  info.GetReturnValue().Set(dir2str(dir));
+  REQUIRE_RESOLVED_UNLESS_TRIVIAL(para);
+  UBiDiDirection dir = para->trivial ? UBIDI_LTR :
+    ubidi_getDirection(para->para);
+  info.GetReturnValue().Set(dir2str(para->addon, dir));
 }
 
 NAN_METHOD(Paragraph::GetLength) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
-  info.GetReturnValue().Set(Nan::New(ubidi_getLength(para->para)));
+  REQUIRE_OPEN(para);
+  info.GetReturnValue().Set(Nan::New(
+    para->pending ? para->length[1] : ubidi_getLength(para->para)
+  ));
 }
 
 NAN_METHOD(Paragraph::GetProcessedLength) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
-  info.GetReturnValue().Set(Nan::New(ubidi_getProcessedLength(para->para)));
+  REQUIRE_OPEN(para);
+  if (!para->ProcessedLengthKnown()) {
+    REQUIRE_RESOLVED(para);
+  }
+  info.GetReturnValue().Set(Nan::New(
+    para->pending ? para->length[1] : ubidi_getProcessedLength(para->para)
+  ));
 }
 
 NAN_METHOD(Paragraph::GetResultLength) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
-  info.GetReturnValue().Set(Nan::New(ubidi_getResultLength(para->para)));
+  REQUIRE_OPEN(para);
+  if (!para->ResultLengthKnown()) {
+    REQUIRE_RESOLVED(para);
+  }
+  info.GetReturnValue().Set(Nan::New(
+    para->pending ? para->length[1] : ubidi_getResultLength(para->para)
+  ));
 }
 
 NAN_METHOD(Paragraph::GetVisualIndex) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_RESOLVED(para);
   REQUIRE_ARGUMENT_NUMBER(0);
   int32_t logicalIndex = Nan::To<int32_t>(info[0]).FromJust();
   int32_t visualIndex =
@@ -357,6 +1374,7 @@ NAN_METHOD(Paragraph::GetVisualIndex) {
 
 NAN_METHOD(Paragraph::GetLogicalIndex) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_RESOLVED(para);
   REQUIRE_ARGUMENT_NUMBER(0);
   int32_t visualIndex = Nan::To<int32_t>(info[0]).FromJust();
   int32_t logicalIndex =
@@ -365,21 +1383,119 @@ NAN_METHOD(Paragraph::GetLogicalIndex) {
   info.GetReturnValue().Set(Nan::New(logicalIndex));
 }
 
-NAN_METHOD(Paragraph::CountRuns) {
+#ifdef BIDI_FAST_API
+/* The Paragraph behind the receiver of a fast call, or NULL (asking V8
+ * for the slow call instead) if it's closed, has failed, or would need
+ * resolving first. */
+Paragraph *Paragraph::FastUnwrap(Local<Object> receiver, bool resolved,
+                                 FastApiCallbackOptions &options) {
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(receiver);
+  if (!para->IsOpen() || U_FAILURE(para->errorCode) ||
+      (resolved && para->pending)) {
+    options.fallback = true;
+    return NULL;
+  }
+  return para;
+}
+
+int32_t Paragraph::FastGetLength(Local<Object> receiver,
+                                 FastApiCallbackOptions &options) {
+  Paragraph *para = FastUnwrap(receiver, false, options);
+  if (para == NULL) { return 0; }
+  return para->pending ? para->length[1] : ubidi_getLength(para->para);
+}
+
+int32_t Paragraph::FastGetLevelAt(Local<Object> receiver, int32_t charIndex,
+                                  FastApiCallbackOptions &options) {
+  Paragraph *para = FastUnwrap(receiver, false, options);
+  if (para == NULL) { return 0; }
+  if (para->trivial) { return 0; }
+  if (para->pending) {
+    options.fallback = true;
+    return 0;
+  }
+  return ubidi_getLevelAt(para->para, charIndex);
+}
+
+int32_t Paragraph::FastGetVisualIndex(Local<Object> receiver,
+                                      int32_t logicalIndex,
+                                      FastApiCallbackOptions &options) {
+  Paragraph *para = FastUnwrap(receiver, true, options);
+  if (para == NULL) { return 0; }
+  UErrorCode errorCode = U_ZERO_ERROR;
+  int32_t visualIndex =
+    ubidi_getVisualIndex(para->para, logicalIndex, &errorCode);
+  // Let the slow call report the error.
+  if (U_FAILURE(errorCode)) { options.fallback = true; }
+  return visualIndex;
+}
+
+int32_t Paragraph::FastGetLogicalIndex(Local<Object> receiver,
+                                       int32_t visualIndex,
+                                       FastApiCallbackOptions &options) {
+  Paragraph *para = FastUnwrap(receiver, true, options);
+  if (para == NULL) { return 0; }
+  UErrorCode errorCode = U_ZERO_ERROR;
+  int32_t logicalIndex =
+    ubidi_getLogicalIndex(para->para, visualIndex, &errorCode);
+  if (U_FAILURE(errorCode)) { options.fallback = true; }
+  return logicalIndex;
+}
+#endif
+
+NAN_METHOD(Paragraph::GetVisualMap) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
-  if (para->runs < 0) {
-    para->runs = ubidi_countRuns(para->para, &para->errorCode);
+  REQUIRE_RESOLVED_UNLESS_TRIVIAL(para);
+  int32_t length = para->trivial ? para->length[1] :
+    ubidi_getResultLength(para->para);
+  Local<Object> result;
+  int32_t *indexMap;
+  if (!bidi_OutputArray<Int32Array>(
+        info.Length() > 0 ? info[0] : (Local<Value>) Nan::Undefined(),
+        &Value::IsInt32Array, length, &result, &indexMap)) {
+    return;
+  }
+  if (para->trivial) {
+    for (int32_t i = 0; i < length; i++) { indexMap[i] = i; }
+  } else if (length > 0) {
+    ubidi_getVisualMap(para->para, indexMap, &para->errorCode);
     CHECK_UBIDI_ERR(para);
   }
-  info.GetReturnValue().Set(Nan::New(para->runs));
+  info.GetReturnValue().Set(result);
 }
 
-NAN_METHOD(Paragraph::GetVisualRun) {
+NAN_METHOD(Paragraph::GetLogicalMap) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
-  if (para->runs < 0) {
-    para->runs = ubidi_countRuns(para->para, &para->errorCode);
+  REQUIRE_RESOLVED_UNLESS_TRIVIAL(para);
+  int32_t length = para->trivial ? para->length[1] :
+    ubidi_getProcessedLength(para->para);
+  Local<Object> result;
+  int32_t *indexMap;
+  if (!bidi_OutputArray<Int32Array>(
+        info.Length() > 0 ? info[0] : (Local<Value>) Nan::Undefined(),
+        &Value::IsInt32Array, length, &result, &indexMap)) {
+    return;
+  }
+  if (para->trivial) {
+    for (int32_t i = 0; i < length; i++) { indexMap[i] = i; }
+  } else if (length > 0) {
+    ubidi_getLogicalMap(para->para, indexMap, &para->errorCode);
     CHECK_UBIDI_ERR(para);
   }
+  info.GetReturnValue().Set(result);
+}
+
+NAN_METHOD(Paragraph::CountRuns) {
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_OPEN(para);
+  REQUIRE_RUNS(para);
+  info.GetReturnValue().Set(Nan::New(para->runs));
+}
+
+NAN_METHOD(Paragraph::GetVisualRun) {
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_RESOLVED(para);
+  REQUIRE_RUNS(para);
   REQUIRE_ARGUMENT_NUMBER(0);
   int32_t runIndex = Nan::To<int32_t>(info[0]).FromJust(), logicalStart, length;
   if (!(runIndex >= 0 && runIndex < para->runs)) {
@@ -388,34 +1504,221 @@ NAN_METHOD(Paragraph::GetVisualRun) {
   UBiDiDirection dir = ubidi_getVisualRun(
     para->para, runIndex, &logicalStart, &length
   );
-  Local<Object> result = Nan::New<Object>();
-  Nan::Set(result, NEW_STR("dir"), dir2str(dir));
-  Nan::Set(result, NEW_STR("logicalStart"), Nan::New(logicalStart));
-  Nan::Set(result, NEW_STR("length"), Nan::New(length));
-  info.GetReturnValue().Set(result);
+  Local<Value> values[] = {
+    dir2str(para->addon, dir), Nan::New(logicalStart), Nan::New(length)
+  };
+  info.GetReturnValue().Set(
+    bidi_NewResult(para->addon, BIDI_SHAPE_VISUAL_RUN, values)
+  );
 }
 
 NAN_METHOD(Paragraph::GetLogicalRun) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
-  if (para->runs < 0) {
-    para->runs = ubidi_countRuns(para->para, &para->errorCode);
-    CHECK_UBIDI_ERR(para);
-  }
+  REQUIRE_RESOLVED(para);
+  REQUIRE_RUNS(para);
   REQUIRE_ARGUMENT_NUMBER(0);
   int32_t logicalPosition = Nan::To<int32_t>(info[0]).FromJust(), logicalLimit;
   UBiDiLevel level;
   ubidi_getLogicalRun(
     para->para, logicalPosition, &logicalLimit, &level
   );
+  Local<Value> values[] = {
+    Nan::New(logicalLimit), Nan::New(level),
+    dir2str(para->addon, level2dir(level))
+  };
+  info.GetReturnValue().Set(
+    bidi_NewResult(para->addon, BIDI_SHAPE_LOGICAL_RUN, values)
+  );
+}
+
+NAN_METHOD(Paragraph::GetRuns) {
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_OPEN(para);
+  REQUIRE_RUNS(para);
+  Local<Object> result;
+  int32_t *dest;
+  if (!bidi_OutputArray<Int32Array>(
+        info.Length() > 0 ? info[0] : (Local<Value>) Nan::Undefined(),
+        &Value::IsInt32Array, 3 * para->runs, &result, &dest)) {
+    return;
+  }
+  // (logicalStart, length, level) triples, in visual order.
+  if (para->trivial) {
+    dest[0] = 0; dest[1] = para->length[1]; dest[2] = 0;
+    return info.GetReturnValue().Set(result);
+  }
+  for (int32_t i = 0; i < para->runs; i++, dest += 3) {
+    ubidi_getVisualRun(para->para, i, &dest[0], &dest[1]);
+    dest[2] = ubidi_getLevelAt(para->para, dest[0]);
+  }
+  info.GetReturnValue().Set(result);
+}
+
+NAN_METHOD(Paragraph::GetLogicalRuns) {
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_OPEN(para);
+  REQUIRE_RUNS(para);
+  Local<Object> result;
+  int32_t *dest;
+  if (!bidi_OutputArray<Int32Array>(
+        info.Length() > 0 ? info[0] : (Local<Value>) Nan::Undefined(),
+        &Value::IsInt32Array, 3 * para->runs, &result, &dest)) {
+    return;
+  }
+  // (logicalStart, length, level) triples, in logical order.  Each
+  // logical run corresponds to exactly one visual run.
+  if (para->trivial) {
+    dest[0] = 0; dest[1] = para->length[1]; dest[2] = 0;
+    return info.GetReturnValue().Set(result);
+  }
+  int32_t length = ubidi_getProcessedLength(para->para);
+  int32_t logicalStart = 0, logicalLimit;
+  UBiDiLevel level;
+  for (int32_t i = 0; i < para->runs && logicalStart < length;
+       i++, dest += 3) {
+    ubidi_getLogicalRun(para->para, logicalStart, &logicalLimit, &level);
+    dest[0] = logicalStart;
+    dest[1] = logicalLimit - logicalStart;
+    dest[2] = level;
+    logicalStart = logicalLimit;
+  }
+  info.GetReturnValue().Set(result);
+}
+
+/* A run of text, as seen from both sides. */
+struct BidiRun {
+  int32_t logicalStart, visualStart, length;
+  UBiDiLevel level;
+};
+
+/* Map each [start, limit) range through the runs, in the order given,
+ * and return the (start, limit, level) segments on the other side of
+ * the map, in order.  `visual` says which side the ranges are on. */
+static void bidi_MapRanges(Nan::NAN_METHOD_ARGS_TYPE info,
+                           const std::vector<BidiRun> &runs,
+                           int32_t length, bool visual) {
+  if (info.Length() < 1 || !info[0]->IsInt32Array()) {
+    return Nan::ThrowTypeError("Argument 0 must be an Int32Array");
+  }
+  Nan::TypedArrayContents<int32_t> ranges(info[0]);
+  if (ranges.length() % 2 != 0) {
+    return Nan::ThrowRangeError("Ranges must be (start, limit) pairs");
+  }
+  int32_t count = (int32_t) ranges.length() / 2;
+  Local<Object> segmentIndex;
+  int32_t *index = NULL;
+  bidi_OutputArray<Int32Array>(Nan::Undefined(), &Value::IsInt32Array,
+                               count + 1, &segmentIndex, &index);
+  std::vector<int32_t> segments;
+  for (int32_t i = 0; i < count; i++) {
+    int32_t start = (*ranges)[2 * i], limit = (*ranges)[2 * i + 1];
+    if (!(start >= 0 && start <= limit && limit <= length)) {
+      return Nan::ThrowRangeError("Ranges must be within the text");
+    }
+    index[i] = (int32_t) segments.size() / 3;
+    size_t first = segments.size();
+    for (size_t j = 0; j < runs.size() && start < limit; j++) {
+      const BidiRun &run = runs[j];
+      int32_t from = visual ? run.visualStart : run.logicalStart;
+      int32_t to = visual ? run.logicalStart : run.visualStart;
+      int32_t a = start > from ? start : from;
+      int32_t b = limit < from + run.length ? limit : from + run.length;
+      if (a >= b) { continue; }
+      // RTL runs are reversed.
+      if (run.level & 1) {
+        segments.push_back(to + from + run.length - b);
+        segments.push_back(to + from + run.length - a);
+      } else {
+        segments.push_back(to + a - from);
+        segments.push_back(to + b - from);
+      }
+      segments.push_back(run.level);
+    }
+    // Put this range's segments in order on their own side.
+    for (size_t j = first + 3; j < segments.size(); j += 3) {
+      for (size_t k = j; k > first && segments[k - 3] > segments[k]; k -= 3) {
+        for (int m = 0; m < 3; m++) {
+          std::swap(segments[k - 3 + m], segments[k + m]);
+        }
+      }
+    }
+  }
+  index[count] = (int32_t) segments.size() / 3;
+
+  Local<Object> segmentArray;
+  int32_t *dest = NULL;
+  bidi_OutputArray<Int32Array>(Nan::Undefined(), &Value::IsInt32Array,
+                               (int32_t) segments.size(), &segmentArray, &dest);
+  if (!segments.empty()) {
+    std::memcpy(dest, &segments[0], segments.size() * sizeof(int32_t));
+  }
   Local<Object> result = Nan::New<Object>();
-  Nan::Set(result, NEW_STR("logicalLimit"), Nan::New(logicalLimit));
-  Nan::Set(result, NEW_STR("level"), Nan::New(level));
-  Nan::Set(result, NEW_STR("dir"), dir2str(level2dir(level)));
+  Nan::Set(result, NEW_STR("segments"), segmentArray);
+  Nan::Set(result, NEW_STR("segmentIndex"), segmentIndex);
   info.GetReturnValue().Set(result);
 }
 
+/* The visual runs of the paragraph, in visual order.  Returns false
+ * (having thrown) if they aren't available. */
+static bool bidi_GetRunTable(UBiDi *para, int32_t count, bool trivial,
+                             int32_t length, std::vector<BidiRun> *runs) {
+  if (!trivial &&
+      0 != (ubidi_getReorderingOptions(para) &
+            (UBIDI_OPTION_INSERT_MARKS | UBIDI_OPTION_REMOVE_CONTROLS))) {
+    Nan::ThrowError(
+      "Ranges can't be mapped with INSERT_MARKS or REMOVE_CONTROLS"
+    );
+    return false;
+  }
+  runs->resize(count);
+  int32_t visualStart = 0;
+  for (int32_t i = 0; i < count; i++) {
+    BidiRun &run = (*runs)[i];
+    if (trivial) {
+      run.logicalStart = 0;
+      run.length = length;
+      run.level = 0;
+    } else {
+      ubidi_getVisualRun(para, i, &run.logicalStart, &run.length);
+      run.level = ubidi_getLevelAt(para, run.logicalStart);
+    }
+    run.visualStart = visualStart;
+    visualStart += run.length;
+  }
+  return true;
+}
+
+NAN_METHOD(Paragraph::LogicalRangesToVisual) {
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_RESOLVED_UNLESS_TRIVIAL(para);
+  REQUIRE_RUNS(para);
+  int32_t length = para->trivial ? para->length[1] :
+    ubidi_getProcessedLength(para->para);
+  std::vector<BidiRun> runs;
+  if (!bidi_GetRunTable(para->para, para->runs, para->trivial, length,
+                        &runs)) {
+    return;
+  }
+  bidi_MapRanges(info, runs, length, false);
+}
+
+NAN_METHOD(Paragraph::VisualRangesToLogical) {
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_RESOLVED_UNLESS_TRIVIAL(para);
+  REQUIRE_RUNS(para);
+  int32_t length = para->trivial ? para->length[1] :
+    ubidi_getResultLength(para->para);
+  std::vector<BidiRun> runs;
+  if (!bidi_GetRunTable(para->para, para->runs, para->trivial, length,
+                        &runs)) {
+    return;
+  }
+  bidi_MapRanges(info, runs, length, true);
+}
+
 NAN_METHOD(Paragraph::GetParagraph) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_RESOLVED(para);
   REQUIRE_ARGUMENT_NUMBER(0);
   int32_t charIndex = Nan::To<int32_t>(info[0]).FromJust(), paraStart, paraLimit;
   UBiDiLevel paraLevel;
@@ -424,17 +1727,18 @@ NAN_METHOD(Paragraph::GetParagraph) {
   );
   CHECK_UBIDI_ERR(para);
 
-  Local<Object> result = Nan::New<Object>();
-  Nan::Set(result, NEW_STR("index"), Nan::New(paraIndex));
-  Nan::Set(result, NEW_STR("start"), Nan::New(paraStart));
-  Nan::Set(result, NEW_STR("limit"), Nan::New(paraLimit));
-  Nan::Set(result, NEW_STR("level"), Nan::New(paraLevel));
-  Nan::Set(result, NEW_STR("dir"), dir2str(level2dir(paraLevel)));
-  info.GetReturnValue().Set(result);
+  Local<Value> values[] = {
+    Nan::New(paraIndex), Nan::New(paraStart), Nan::New(paraLimit),
+    Nan::New(paraLevel), dir2str(para->addon, level2dir(paraLevel))
+  };
+  info.GetReturnValue().Set(
+    bidi_NewResult(para->addon, BIDI_SHAPE_PARAGRAPH, values)
+  );
 }
 
 NAN_METHOD(Paragraph::GetParagraphByIndex) {
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_RESOLVED(para);
   REQUIRE_ARGUMENT_NUMBER(0);
   int32_t paraIndex = Nan::To<int32_t>(info[0]).FromJust(), paraStart, paraLimit;
   UBiDiLevel paraLevel;
@@ -443,48 +1747,324 @@ NAN_METHOD(Paragraph::GetParagraphByIndex) {
   );
   CHECK_UBIDI_ERR(para);
 
-  Local<Object> result = Nan::New<Object>();
-  Nan::Set(result, NEW_STR("index"), Nan::New(paraIndex));
-  Nan::Set(result, NEW_STR("start"), Nan::New(paraStart));
-  Nan::Set(result, NEW_STR("limit"), Nan::New(paraLimit));
-  Nan::Set(result, NEW_STR("level"), Nan::New(paraLevel));
-  Nan::Set(result, NEW_STR("dir"), dir2str(level2dir(paraLevel)));
-  info.GetReturnValue().Set(result);
+  Local<Value> values[] = {
+    Nan::New(paraIndex), Nan::New(paraStart), Nan::New(paraLimit),
+    Nan::New(paraLevel), dir2str(para->addon, level2dir(paraLevel))
+  };
+  info.GetReturnValue().Set(
+    bidi_NewResult(para->addon, BIDI_SHAPE_PARAGRAPH, values)
+  );
 }
 
+/* Write the reordered text into `out`.  Returns false if ICU failed. */
+bool Paragraph::Reorder(uint16_t options, ReorderedText *out) {
+  if (IsTrivialReorder(options)) {
+    out->data = start[1];
+    out->length = length[1];
+    return true;
+  }
+  if (!Resolve()) { return false; }
+  if (shared != NULL) {
+    const std::vector<UChar> *result =
+      bidi_CacheReordered(addon, shared, options, &errorCode);
+    if (result == NULL) { return false; }
+    out->data = result->empty() ? start[1] : &(*result)[0];
+    out->length = (int32_t) result->size();
+    return true;
+  }
+  int32_t destSize = bidi_ReorderedSize(para, options, &errorCode);
+  if (U_FAILURE(errorCode)) { return false; }
+  UChar *dest = out->Allocate(destSize);
+  BIDI_TIMED(addon->stats, writeReordered, out->length =
+    ubidi_writeReordered(para, dest, destSize, options, &errorCode));
+  out->data = dest;
+  return U_SUCCESS(errorCode);
+}
+
+#define REQUIRE_REORDERED(obj, options, out)                        \
+  do {                                                              \
+    if (!(obj)->Reorder((options), (out))) {                        \
+      CHECK_UBIDI_ERR(obj);                                         \
+      return Nan::ThrowError("libicu open failed");                 \
+    }                                                               \
+  } while (false)
+
 NAN_METHOD(Paragraph::WriteReordered) {
+  BidiTraceScope trace("Paragraph#writeReordered");
   Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_OPEN(para);
   uint16_t options = 0;
   if (info.Length() > 0) {
     REQUIRE_ARGUMENT_NUMBER(0);
     options = (uint16_t) Nan::To<uint32_t>(info[0]).FromJust();
   }
-  // Allocate a buffer to hold the result.
-  int32_t destSize = ubidi_getProcessedLength(para->para);
-  if (ubidi_getLength(para->para) > destSize) {
-    destSize = ubidi_getLength(para->para);
+  ReorderedText result;
+  REQUIRE_REORDERED(para, options, &result);
+  info.GetReturnValue().Set(
+    Nan::New<String>(result.data, result.length).ToLocalChecked()
+  );
+}
+
+/* writeReorderedInto(array, [options]): write UTF-16 into a Uint16Array,
+ * or UTF-8 into a Buffer or Uint8Array.  Returns the number of code
+ * units or bytes written. */
+NAN_METHOD(Paragraph::WriteReorderedInto) {
+  BidiTraceScope trace("Paragraph#writeReorderedInto");
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_OPEN(para);
+  REQUIRE_ARGUMENTS(1);
+  uint16_t options = 0;
+  if (info.Length() > 1) {
+    REQUIRE_ARGUMENT_NUMBER(1);
+    options = (uint16_t) Nan::To<uint32_t>(info[1]).FromJust();
   }
-  if (0 != (options & UBIDI_INSERT_LRM_FOR_NUMERIC)) {
-    destSize += 2 * ubidi_countRuns(para->para, &para->errorCode);
-    CHECK_UBIDI_ERR(para);
+  int32_t written;
+  if (info[0]->IsUint16Array()) {
+    Nan::TypedArrayContents<uint16_t> contents(info[0]);
+    int32_t capacity = contents.length() > INT32_MAX ? INT32_MAX :
+      (int32_t) contents.length();
+    UChar *dest = (UChar *) *contents;
+    if (para->IsTrivialReorder(options)) {
+      written = para->length[1];
+      if (written <= capacity && written > 0) {
+        std::memcpy(dest, para->start[1], written * sizeof(UChar));
+      }
+    } else {
+      REQUIRE_RESOLVED(para);
+      // ICU writes straight into the caller's array.
+      BIDI_TIMED(para->addon->stats, writeReordered, written =
+        ubidi_writeReordered(para->para, capacity == 0 ? NULL : dest,
+                             capacity, options, &para->errorCode));
+      if (para->errorCode == U_BUFFER_OVERFLOW_ERROR) {
+        para->errorCode = U_ZERO_ERROR;
+      }
+      CHECK_UBIDI_ERR(para);
+    }
+    if (written > capacity) {
+      return Nan::ThrowRangeError("Output array is too small");
+    }
+  } else if (info[0]->IsUint8Array()) {
+    Nan::TypedArrayContents<char> contents(info[0]);
+    int32_t capacity = contents.length() > INT32_MAX ? INT32_MAX :
+      (int32_t) contents.length();
+    ReorderedText result;
+    REQUIRE_REORDERED(para, options, &result);
+    UErrorCode errorCode = U_ZERO_ERROR;
+    // Like node, replace unpaired surrogates with U+FFFD.
+    u_strToUTF8WithSub(capacity == 0 ? NULL : *contents, capacity, &written,
+                       result.data, result.length, 0xFFFD, NULL, &errorCode);
+    if (errorCode == U_BUFFER_OVERFLOW_ERROR) {
+      return Nan::ThrowRangeError("Output array is too small");
+    } else if (U_FAILURE(errorCode)) {
+      return Nan::ThrowError(bidi_MakeError(errorCode));
+    }
+  } else {
+    return Nan::ThrowTypeError(
+      "First argument must be a Uint16Array, Uint8Array or Buffer"
+    );
+  }
+  info.GetReturnValue().Set(Nan::New(written));
+}
+
+/* writeReorderedUtf8([options]): the reordered text as a UTF-8 Buffer. */
+NAN_METHOD(Paragraph::WriteReorderedUtf8) {
+  BidiTraceScope trace("Paragraph#writeReorderedUtf8");
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_OPEN(para);
+  uint16_t options = 0;
+  if (info.Length() > 0) {
+    REQUIRE_ARGUMENT_NUMBER(0);
+    options = (uint16_t) Nan::To<uint32_t>(info[0]).FromJust();
+  }
+  ReorderedText result;
+  REQUIRE_REORDERED(para, options, &result);
+  // Measure first, so that the Buffer is exactly the right size.
+  UErrorCode errorCode = U_ZERO_ERROR;
+  int32_t size;
+  u_strToUTF8WithSub(NULL, 0, &size, result.data, result.length,
+                     0xFFFD, NULL, &errorCode);
+  if (errorCode != U_BUFFER_OVERFLOW_ERROR && U_FAILURE(errorCode)) {
+    return Nan::ThrowError(bidi_MakeError(errorCode));
+  }
+  Local<Object> buffer = Nan::NewBuffer(size).ToLocalChecked();
+  errorCode = U_ZERO_ERROR;
+  u_strToUTF8WithSub(node::Buffer::Data(buffer), size, &size,
+                     result.data, result.length, 0xFFFD, NULL, &errorCode);
+  if (U_FAILURE(errorCode)) {
+    return Nan::ThrowError(bidi_MakeError(errorCode));
+  }
+  info.GetReturnValue().Set(buffer);
+}
+
+/* shapeAndReorder([shapeOptions], [options]): the reordered text, with
+ * Arabic shaping applied.  Shaping is done on the visual result, so ICU
+ * gets the joining context of each RTL run the right way round and
+ * digits are shaped only after they've been placed. */
+NAN_METHOD(Paragraph::ShapeAndReorder) {
+  BidiTraceScope trace("Paragraph#shapeAndReorder");
+  Paragraph *para = Nan::ObjectWrap::Unwrap<Paragraph>(info.Holder());
+  REQUIRE_OPEN(para);
+  uint32_t shapeOptions = U_SHAPE_LETTERS_SHAPE;
+  uint16_t options = 0;
+  if (info.Length() > 0) {
+    REQUIRE_ARGUMENT_NUMBER(0);
+    shapeOptions = Nan::To<uint32_t>(info[0]).FromJust();
+  }
+  if (info.Length() > 1) {
+    REQUIRE_ARGUMENT_NUMBER(1);
+    options = (uint16_t) Nan::To<uint32_t>(info[1]).FromJust();
+  }
+  shapeOptions &= ~U_SHAPE_TEXT_DIRECTION_MASK;
+  shapeOptions |= 0 != (options & UBIDI_OUTPUT_REVERSE) ?
+    U_SHAPE_TEXT_DIRECTION_VISUAL_RTL : U_SHAPE_TEXT_DIRECTION_VISUAL_LTR;
+  // Reorder into the first half of the buffer and shape into the second,
+  // since u_shapeArabic can't work in place.
+  ReorderedText scratch(2);
+  REQUIRE_REORDERED(para, options, &scratch);
+  // Shaping usually keeps the length or shrinks it (lam-alef ligatures);
+  // only unshaping can grow it, so that's when we try again.
+  UErrorCode errorCode = U_ZERO_ERROR;
+  int32_t size = scratch.length;
+  UChar *dest = scratch.Spare(size);
+  int32_t length = u_shapeArabic(scratch.data, scratch.length,
+                                 dest, size, shapeOptions, &errorCode);
+  if (errorCode == U_BUFFER_OVERFLOW_ERROR) {
+    errorCode = U_ZERO_ERROR;
+    size = length;
+    dest = scratch.Spare(size);
+    length = u_shapeArabic(scratch.data, scratch.length,
+                           dest, size, shapeOptions, &errorCode);
   }
-  UChar dest[destSize];
-  int32_t resultSize = ubidi_writeReordered(
-    para->para, dest, destSize, options, &para->errorCode
+  if (U_FAILURE(errorCode)) {
+    return Nan::ThrowError(bidi_MakeError(errorCode));
+  }
+  info.GetReturnValue().Set(
+    Nan::New<String>(dest, length).ToLocalChecked()
   );
-  CHECK_UBIDI_ERR(para);
-  if (resultSize > destSize) {
-    return Nan::ThrowError("Allocation error (this should never happen)");
+}
+
+/* ubidi.getBaseDirection(text, [options]): the direction of the first
+ * strong character in the text, without running the bidi algorithm. */
+static NAN_METHOD(GetBaseDirection) {
+  REQUIRE_ARGUMENTS(1);
+  BidiEncoding encoding = BIDI_UTF8;
+  if (info.Length() > 1 && info[1]->IsObject() &&
+      !bidi_ParseEncoding(GET_PROPERTY(info[1].As<Object>(), "encoding"),
+                          &encoding)) {
+    return;
   }
-  info.GetReturnValue().Set(Nan::New<String>(dest, resultSize).ToLocalChecked());
+  Local<Value> value = info[0];
+  if (!value->IsArrayBufferView()) {
+    Nan::MaybeLocal<String> maybeText = Nan::To<String>(value);
+    if (maybeText.IsEmpty()) {
+      return Nan::ThrowTypeError(
+        "First argument couldn't be converted to a string"
+      );
+    }
+    value = maybeText.ToLocalChecked();
+  }
+  BidiInput input;
+  if (!bidi_ParseInput(value, encoding, &input)) {
+    return;
+  }
+  UBiDiDirection dir = UBIDI_NEUTRAL;
+  if (input.kind == BidiInput::UTF16) {
+    dir = ubidi_getBaseDirection(input.data, input.length);
+  } else if (input.kind == BidiInput::STRING) {
+    // The first strong character is usually near the start, so copy the
+    // string out a piece at a time.
+    const int32_t CHUNK = 256;
+    UChar chunk[CHUNK];
+    Local<String> str = value.As<String>();
+    for (int32_t i = 0; i < input.length && dir == UBIDI_NEUTRAL; ) {
+      int32_t n = bidi_WriteString(str, chunk, i, CHUNK);
+      // Don't split a surrogate pair between chunks.
+      if (n == CHUNK && U16_IS_LEAD(chunk[n - 1])) { n--; }
+      dir = ubidi_getBaseDirection(chunk, n);
+      i += n;
+    }
+  } else {
+    UChar *buffer = new UChar[input.length > 0 ? input.length : 1];
+    int32_t length = bidi_CopyInput(input, buffer);
+    dir = ubidi_getBaseDirection(buffer, length);
+    delete[] buffer;
+  }
+  info.GetReturnValue().Set(dir2str(bidi_GetAddon(info.Data()), dir));
 }
 
+/* ubidi.stats(): counters describing the work done so far. */
+static NAN_METHOD(GetStats) {
+  const BidiStats &stats = bidi_GetAddon(info.Data())->stats;
+  Local<Object> result = Nan::New<Object>();
+#define BIDI_STAT(name)                                             \
+  Nan::Set(result, NEW_STR(#name), Nan::New<Number>((double) stats.name))
+  BIDI_STAT(paragraphsCreated);
+  BIDI_STAT(paragraphsLive);
+  BIDI_STAT(linesCreated);
+  BIDI_STAT(linesLive);
+  BIDI_STAT(bytesProcessed);
+  BIDI_STAT(nativeBytes);
+  BIDI_STAT(setParaCalls);
+  BIDI_STAT(setParaTime);
+  BIDI_STAT(writeReorderedCalls);
+  BIDI_STAT(writeReorderedTime);
+  BIDI_STAT(cacheHits);
+  BIDI_STAT(cacheMisses);
+#undef BIDI_STAT
+  info.GetReturnValue().Set(result);
+}
 
-// Tell node about our module!
-NAN_MODULE_INIT(RegisterModule) {
-  Nan::HandleScope scope;
+/* ubidi.setCacheSize(size): keep the results for up to `size` recently
+ * used paragraphs, and share them between Paragraphs with the same text
+ * and options.  0 turns the cache off. */
+static NAN_METHOD(SetCacheSize) {
+  REQUIRE_ARGUMENT_INTEGER(0, size);
+  if (size < 0) {
+    return Nan::ThrowRangeError("Cache size must not be negative");
+  }
+  bidi_SetCacheSize(bidi_GetAddon(info.Data()), (size_t) size);
+}
+
+/* Like Nan::SetMethod, but passing our instance as the data. */
+static void bidi_SetMethod(Local<Object> target, const char *name,
+                           Nan::FunctionCallback callback,
+                           BidiAddon *addon) {
+  Local<FunctionTemplate> t = Nan::New<FunctionTemplate>(
+    callback, Nan::New<External>(addon)
+  );
+  Local<Function> fn = Nan::GetFunction(t).ToLocalChecked();
+  fn->SetName(NEW_STR(name));
+  Nan::Set(target, NEW_STR(name), fn);
+}
 
-  Paragraph::Init(target);
+// Environment cleanup hooks arrived with worker threads, in node 10.
+#if NODE_MAJOR_VERSION > 10 || \
+  (NODE_MAJOR_VERSION == 10 && NODE_MINOR_VERSION >= 2)
+#define BIDI_HAVE_CLEANUP_HOOK 1
+static void bidi_Cleanup(void *arg) {
+  BidiAddon *addon = (BidiAddon *) arg;
+  bidi_SetCacheSize(addon, 0);
+  addon->paragraphTemplate.Reset();
+  bidi_FreeStrings(addon);
+  bidi_AddonUnref(addon);
+}
+#endif
+
+// Tell node about our module!  This may happen once for each thread.
+static void RegisterModule(Local<Object> target, Local<Value> /* module */,
+                           Local<Context> context, void * /* priv */) {
+  Nan::HandleScope scope;
+  BidiAddon *addon = new BidiAddon();
+#ifdef BIDI_HAVE_CLEANUP_HOOK
+  node::AddEnvironmentCleanupHook(context->GetIsolate(), bidi_Cleanup, addon);
+#endif
+
+  bidi_InitStrings(addon);
+  Paragraph::Init(target, addon);
+  bidi_SetMethod(target, "processBatch", ProcessBatch, addon);
+  bidi_SetMethod(target, "getBaseDirection", GetBaseDirection, addon);
+  bidi_SetMethod(target, "stats", GetStats, addon);
+  bidi_SetMethod(target, "setCacheSize", SetCacheSize, addon);
 
   DEFINE_CONSTANT_INTEGER(target, UBIDI_LTR, LTR);
   DEFINE_CONSTANT_INTEGER(target, UBIDI_RTL, RTL);
@@ -493,6 +2073,7 @@ NAN_MODULE_INIT(RegisterModule) {
   DEFINE_CONSTANT_INTEGER(target, UBIDI_MAX_EXPLICIT_LEVEL, MAX_EXPLICIT_LEVEL);
   DEFINE_CONSTANT_INTEGER(target, UBIDI_LEVEL_OVERRIDE, LEVEL_OVERRIDE);
   DEFINE_CONSTANT_INTEGER(target, UBIDI_MAP_NOWHERE, MAP_NOWHERE);
+  DEFINE_CONSTANT_STRING(target, U_ICU_VERSION, ICU_VERSION);
 
   // Reordered.<constant>: option bits for writeReordered
   Local<Object> re = Nan::New<Object>();
@@ -525,6 +2106,34 @@ NAN_MODULE_INIT(RegisterModule) {
   DEFINE_CONSTANT_INTEGER(ro, UBIDI_OPTION_REMOVE_CONTROLS, REMOVE_CONTROLS);
   DEFINE_CONSTANT_INTEGER(ro, UBIDI_OPTION_STREAMING, STREAMING);
 
+  // Shape.<constant>: option bits for shapeAndReorder
+  Local<Object> sh = Nan::New<Object>();
+  Nan::ForceSet(target, NEW_STR("Shape"), sh,
+                    static_cast<PropertyAttribute>(ReadOnly | DontDelete));
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_LETTERS_NOOP, LETTERS_NOOP);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_LETTERS_SHAPE, LETTERS_SHAPE);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_LETTERS_UNSHAPE, LETTERS_UNSHAPE);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_LETTERS_SHAPE_TASHKEEL_ISOLATED, LETTERS_SHAPE_TASHKEEL_ISOLATED);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_DIGITS_NOOP, DIGITS_NOOP);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_DIGITS_EN2AN, DIGITS_EN2AN);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_DIGITS_AN2EN, DIGITS_AN2EN);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_DIGITS_ALEN2AN_INIT_LR, DIGITS_ALEN2AN_INIT_LR);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_DIGITS_ALEN2AN_INIT_AL, DIGITS_ALEN2AN_INIT_AL);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_DIGIT_TYPE_AN, DIGIT_TYPE_AN);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_DIGIT_TYPE_AN_EXTENDED, DIGIT_TYPE_AN_EXTENDED);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_LENGTH_GROW_SHRINK, LENGTH_GROW_SHRINK);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_LENGTH_FIXED_SPACES_NEAR, LENGTH_FIXED_SPACES_NEAR);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_LENGTH_FIXED_SPACES_AT_END, LENGTH_FIXED_SPACES_AT_END);
+  DEFINE_CONSTANT_INTEGER(sh, U_SHAPE_LENGTH_FIXED_SPACES_AT_BEGINNING, LENGTH_FIXED_SPACES_AT_BEGINNING);
+
 }
 
-NODE_MODULE(icu_bidi, RegisterModule)
+#ifdef NODE_MODULE_INIT
+// Exports a well-known symbol as well, which node uses to initialize us
+// in every thread after the first.
+NODE_MODULE_INIT() {
+  RegisterModule(exports, module, context, NULL);
+}
+#else
+NODE_MODULE_CONTEXT_AWARE(icu_bidi, RegisterModule)
+#endif
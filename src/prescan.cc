@@ -0,0 +1,102 @@
+#include <stdint.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BIDI_HAVE_SSE2 1
+#endif
+
+#include "unicode/ubidi.h"
+#include "unicode/uchar.h"
+#include "unicode/utf16.h"
+
+#include "bidi.h"
+
+/* Code units in [0x20, 0x7E] and [0xA0, 0x058F] (printable ASCII and the
+ * Latin, Greek, Cyrillic and Armenian blocks) are never R, AL or AN, and
+ * are neither paragraph separators nor explicit bidi controls.  Tab is
+ * allowed too: it is a segment separator, which resolves to the paragraph
+ * level.  Surrogates fall outside both ranges, so supplementary
+ * characters always take the slow path. */
+static inline bool bidi_IsSimpleLTRChar(UChar c) {
+  return (uint16_t) (c - 0x20) <= 0x7E - 0x20 ||
+    (uint16_t) (c - 0xA0) <= 0x058F - 0xA0 ||
+    c == 0x09;
+}
+
+bool bidi_IsSimpleLTR(const UChar *text, int32_t length) {
+  int32_t i = 0;
+#ifdef BIDI_HAVE_SSE2
+  // Check eight code units at a time; fall back to the scalar test for
+  // any block which contains something outside the two main ranges
+  // (typically a tab).
+  const __m128i lo1 = _mm_set1_epi16(0x20), span1 = _mm_set1_epi16(0x7E - 0x20);
+  const __m128i lo2 = _mm_set1_epi16(0xA0), span2 = _mm_set1_epi16(0x058F - 0xA0);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= length; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (text + i));
+    // (c - lo) <= span, unsigned: the saturating difference is zero.
+    __m128i in1 = _mm_cmpeq_epi16(
+      _mm_subs_epu16(_mm_sub_epi16(v, lo1), span1), zero
+    );
+    __m128i in2 = _mm_cmpeq_epi16(
+      _mm_subs_epu16(_mm_sub_epi16(v, lo2), span2), zero
+    );
+    if (_mm_movemask_epi8(_mm_or_si128(in1, in2)) != 0xFFFF) {
+      for (int32_t j = i; j < i + 8; j++) {
+        if (!bidi_IsSimpleLTRChar(text[j])) { return false; }
+      }
+    }
+  }
+#endif
+  for (; i < length; i++) {
+    if (!bidi_IsSimpleLTRChar(text[i])) { return false; }
+  }
+  return true;
+}
+
+/* Rules P2 and P3 of the bidi algorithm: the level of the first
+ * paragraph is given by its first strong character, skipping anything
+ * inside an isolate. */
+UBiDiLevel bidi_FirstParaLevel(const UChar *text, int32_t length,
+                               UBiDiLevel paraLevel) {
+  if (paraLevel < UBIDI_DEFAULT_LTR) {
+    return paraLevel;
+  }
+  int32_t isolates = 0;
+  for (int32_t i = 0; i < length; ) {
+    UChar32 c;
+    U16_NEXT(text, i, length, c);
+    switch (u_charDirection(c)) {
+    case U_LEFT_TO_RIGHT:
+      if (isolates == 0) { return 0; }
+      break;
+    case U_RIGHT_TO_LEFT:
+    case U_RIGHT_TO_LEFT_ARABIC:
+      if (isolates == 0) { return 1; }
+      break;
+    case U_LEFT_TO_RIGHT_ISOLATE:
+    case U_RIGHT_TO_LEFT_ISOLATE:
+    case U_FIRST_STRONG_ISOLATE:
+      isolates++;
+      break;
+    case U_POP_DIRECTIONAL_ISOLATE:
+      if (isolates > 0) { isolates--; }
+      break;
+    case U_BLOCK_SEPARATOR:
+      return paraLevel & 1;
+    default:
+      break;
+    }
+  }
+  return paraLevel & 1;
+}
+
+bool bidi_IsDefaultLTR(const BidiOptions &opts) {
+  return (opts.paraLevel == 0 || opts.paraLevel == UBIDI_DEFAULT_LTR) &&
+    (opts.reorderingMode < 0 ||
+     opts.reorderingMode == UBIDI_REORDER_DEFAULT) &&
+    opts.reorderingOptions <= 0 &&
+    opts.inverse <= 0 &&
+    opts.embeddingLevels == NULL &&
+    opts.prologue.length == 0 &&
+    opts.epilogue.length == 0;
+}
@@ -0,0 +1,63 @@
+// Check the asynchronous batch API.
+require('should');
+
+describe('Batch processing', function() {
+    var ubidi = require('../');
+    var e = 'English';
+    var h = 'עִבְרִית';
+    var hrev = 'תיִרְבִע';
+    it('should reorder a batch of strings', function() {
+        return ubidi.processBatch([e, h, e + ' ' + h, ''], {
+            levels: true,
+            runs: true
+        }).then(function(results) {
+            results.length.should.equal(4);
+            results[0].reordered.should.equal(e);
+            results[0].dir.should.equal('ltr');
+            results[1].reordered.should.equal(hrev);
+            results[1].dir.should.equal('rtl');
+            results[1].paraLevel.should.equal(1);
+            results[2].reordered.should.equal(e + ' ' + hrev);
+            results[2].dir.should.equal('mixed');
+            results[3].reordered.should.equal('');
+            results[2].levels.should.eql(
+                ubidi.Paragraph(e + ' ' + h).getLevels()
+            );
+            results[2].runs.should.eql(
+                ubidi.Paragraph(e + ' ' + h).getRuns()
+            );
+        });
+    });
+    it('should match the synchronous API', function(done) {
+        var texts = [], i;
+        for (i = 0; i < 500; i++) {
+            texts.push('(' + i + ' ' + h + ') ' + e + ' ' + i);
+        }
+        var options = {
+            paraLevel: ubidi.RTL,
+            writeOptions: ubidi.Reordered.DO_MIRRORING,
+            epilogue: e
+        };
+        ubidi.processBatch(texts, options, function(err, results) {
+            if (err) { return done(err); }
+            results.length.should.equal(texts.length);
+            for (i = 0; i < texts.length; i++) {
+                results[i].reordered.should.equal(
+                    ubidi.Paragraph(texts[i], options).
+                        writeReordered(ubidi.Reordered.DO_MIRRORING)
+                );
+                results[i].should.not.have.property('levels');
+            }
+            done();
+        });
+    });
+    it('should reject bad arguments', function() {
+        (function() { ubidi.processBatch('abc', {}, function() {}); }).
+            should.throw();
+        (function() {
+            ubidi.processBatch([{
+                toString: function() { throw new Error('boo'); }
+            }], {}, function() {});
+        }).should.throw();
+    });
+});
@@ -266,4 +266,475 @@ describe('Bidi algorithm', function() {
         p.getParagraph(3).should.eql(para1);
         p.getParagraph(e.length + 4).should.eql(para2);
     });
+    it('should return all levels at once', function() {
+        var e = 'English';
+        var h = 'עִבְרִית';
+        var p = ubidi.Paragraph(e + ' ' + h);
+        var levels = p.getLevels();
+        levels.should.be.instanceof(Uint8Array);
+        levels.length.should.equal(p.getProcessedLength());
+        for (var i = 0; i < levels.length; i++) {
+            levels[i].should.equal(p.getLevelAt(i));
+        }
+        // reuse a caller-supplied buffer
+        var buf = new Uint8Array(32);
+        p.getLevels(buf).should.equal(buf);
+        buf[e.length + 1].should.equal(1);
+        (function() { p.getLevels(new Uint8Array(2)); }).should.throw();
+        (function() { p.getLevels(new Int32Array(32)); }).should.throw();
+        ubidi.Paragraph('').getLevels().length.should.equal(0);
+    });
+    it('should return whole index maps', function() {
+        var e = 'English';
+        var h = 'עִבְרִית';
+        var p = ubidi.Paragraph(e + ' ' + h + '!');
+        var n = p.getLength();
+        var vmap = p.getVisualMap();
+        var lmap = p.getLogicalMap();
+        vmap.should.be.instanceof(Int32Array);
+        lmap.should.be.instanceof(Int32Array);
+        vmap.length.should.equal(p.getResultLength());
+        lmap.length.should.equal(p.getProcessedLength());
+        for (var i = 0; i < n; i++) {
+            vmap[i].should.equal(p.getLogicalIndex(i));
+            lmap[i].should.equal(p.getVisualIndex(i));
+        }
+        var buf = new Int32Array(n);
+        p.getVisualMap(buf).should.equal(buf);
+        buf.should.eql(vmap);
+        (function() { p.getLogicalMap(new Int32Array(1)); }).should.throw();
+    });
+    it('should keep MAP_NOWHERE entries in index maps', function() {
+        var p = ubidi.Paragraph('a\u202Eb\u202Cc', {
+            reorderingOptions: ubidi.ReorderingOption.REMOVE_CONTROLS
+        });
+        p.getResultLength().should.equal(3);
+        var lmap = p.getLogicalMap();
+        lmap.length.should.equal(5);
+        lmap[1].should.equal(ubidi.MAP_NOWHERE);
+        lmap[3].should.equal(ubidi.MAP_NOWHERE);
+        p.getVisualMap().length.should.equal(3);
+    });
+    it('should return packed run tables', function() {
+        var e = 'English';
+        var h = 'עִבְרִית';
+        var p = ubidi.Paragraph('(' + e + ' ' + h + ')');
+        var runs = p.getRuns();
+        runs.should.be.instanceof(Int32Array);
+        runs.length.should.equal(3 * p.countRuns());
+        for (var i = 0; i < p.countRuns(); i++) {
+            var run = p.getVisualRun(i);
+            runs[3*i].should.equal(run.logicalStart);
+            runs[3*i + 1].should.equal(run.length);
+            (runs[3*i + 2] & 1 ? 'rtl' : 'ltr').should.equal(run.dir);
+        }
+        Array.prototype.slice.call(p.getLogicalRuns()).should.eql([
+            0, 9, 0,
+            9, 8, 1,
+            17, 1, 0
+        ]);
+        var buf = new Int32Array(16);
+        p.getRuns(buf).should.equal(buf);
+        buf[3].should.equal(9);
+        (function() { p.getLogicalRuns(new Int32Array(3)); }).should.throw();
+    });
+    it('should allow paragraphs to be reset', function() {
+        var e = 'English';
+        var h = 'עִבְרִית';
+        var p = ubidi.Paragraph(e, { paraLevel: ubidi.RTL, prologue: h });
+        p.getParaLevel().should.equal(1);
+        p.reset(h).should.equal(p);
+        p.getParaLevel().should.equal(1);
+        p.getDirection().should.equal('rtl');
+        p.getLength().should.equal(h.length);
+        // longer text, and options are not carried over from before
+        p.reset(e + ' ' + h + ' ' + e);
+        p.getParaLevel().should.equal(0);
+        p.countRuns().should.equal(3);
+        p.reset('.-=', { prologue: h });
+        p.getDirection().should.equal('rtl');
+        p.reset('.-=');
+        p.getDirection().should.equal('ltr');
+        (function() { p.setLine(0, 1).reset(e); }).should.throw();
+    });
+    it('should invalidate lines when their paragraph is reset', function() {
+        var p = ubidi.Paragraph('English text');
+        var l = p.setLine(0, 7);
+        l.getLength().should.equal(7);
+        p.reset('Other text');
+        (function() { l.getLength(); }).should.throw();
+        p.setLine(0, 5).getLength().should.equal(5);
+    });
+    it('should allow paragraphs to be closed', function() {
+        var p = ubidi.Paragraph('English text');
+        var l = p.setLine(0, 7);
+        p.close();
+        p.close(); // closing twice is harmless
+        (function() { p.getLength(); }).should.throw();
+        (function() { p.countRuns(); }).should.throw();
+        (function() { l.getLength(); }).should.throw();
+        // a closed paragraph can be reset, though
+        p.reset('abc').getLength().should.equal(3);
+        var l2 = p.setLine(0, 2);
+        l2.dispose();
+        (function() { l2.getLength(); }).should.throw();
+        p.getLength().should.equal(3);
+    });
+    it('should accept UTF-16 typed arrays and buffers', function() {
+        var e = 'English';
+        var h = 'עִבְרִית';
+        var text = e + ' ' + h;
+        var expected = ubidi.Paragraph(text).writeReordered();
+        var u16 = new Uint16Array(text.length);
+        for (var i = 0; i < text.length; i++) { u16[i] = text.charCodeAt(i); }
+        var p = ubidi.Paragraph(u16);
+        p.getLength().should.equal(text.length);
+        p.writeReordered().should.equal(expected);
+        var buf = Buffer.from(text, 'utf16le');
+        ubidi.Paragraph(buf, { encoding: 'utf16le' }).
+            writeReordered().should.equal(expected);
+        // misaligned buffers are copied
+        var odd = Buffer.alloc(buf.length + 1);
+        buf.copy(odd, 1);
+        ubidi.Paragraph(odd.slice(1), { encoding: 'ucs2' }).
+            writeReordered().should.equal(expected);
+        (function() {
+            ubidi.Paragraph(odd, { encoding: 'utf16le' });
+        }).should.throw();
+        (function() {
+            ubidi.Paragraph(buf, { encoding: 'latin1' });
+        }).should.throw();
+    });
+    it('should keep using UTF-16 text whose buffer is transferred', function() {
+        var W;
+        try {
+            W = require('worker_threads');
+        } catch (e) {
+            W = null; // node < 10, or node 10 without --experimental-worker
+        }
+        if (!W) { return this.skip(); }
+        var text = new Array(200).join('English עִבְרִית (123) ');
+        var expected = ubidi.Paragraph(text).writeReordered();
+        var u16 = new Uint16Array(text.length);
+        for (var i = 0; i < text.length; i++) { u16[i] = text.charCodeAt(i); }
+        var p = ubidi.Paragraph(u16);
+        // Transferring the buffer detaches it here, and its memory is
+        // freed once the worker has gone.
+        var worker = new W.Worker(
+            "require('worker_threads').parentPort.once('message', " +
+            "function() { process.exit(0); });", { eval: true }
+        );
+        worker.postMessage(u16, [u16.buffer]);
+        u16.length.should.equal(0);
+        return new Promise(function(resolve) {
+            worker.on('exit', function() { setTimeout(resolve, 50); });
+        }).then(function() {
+            if (global.gc) { global.gc(); }
+            var junk = [];
+            for (var i = 0; i < 1000; i++) {
+                junk.push(Buffer.alloc(2 * text.length, 0x41));
+            }
+            p.writeReordered().should.equal(expected);
+            p.getLength().should.equal(text.length);
+        });
+    });
+    it('should accept UTF-8 buffers', function() {
+        var e = 'English';
+        var h = 'עִבְרִית';
+        var p = ubidi.Paragraph(Buffer.from(e + ' ' + h + ' \ud83d\ude00'));
+        p.getLength().should.equal(e.length + h.length + 4);
+        p.writeReordered().should.equal(
+            ubidi.Paragraph(e + ' ' + h + ' \ud83d\ude00').writeReordered()
+        );
+        // malformed UTF-8 is replaced with U+FFFD
+        ubidi.Paragraph(Buffer.from([0x61, 0xff, 0x62])).writeReordered().
+            should.equal('a\ufffdb');
+    });
+    it('should accept buffers for the prologue and epilogue', function() {
+        var h = 'עִבְרִית';
+        var u16 = new Uint16Array(h.length);
+        for (var i = 0; i < h.length; i++) { u16[i] = h.charCodeAt(i); }
+        ubidi.Paragraph('.-=', { prologue: u16 }).
+            getDirection().should.equal('rtl');
+        ubidi.Paragraph('.-=', { prologue: Buffer.from(h) }).
+            getDirection().should.equal('rtl');
+        var p = ubidi.Paragraph(Buffer.from('.-=' + h, 'utf16le'), {
+            paraLevel: ubidi.LTR,
+            epilogue: Buffer.from(' \u0634', 'utf16le'),
+            encoding: 'utf16le'
+        });
+        p.getLength().should.equal(3 + h.length);
+        p.writeReordered().should.equal(ubidi.Paragraph('.-=' + h, {
+            paraLevel: ubidi.LTR,
+            epilogue: ' \u0634'
+        }).writeReordered());
+    });
+    it('should give the same answers for plain LTR text', function() {
+        // A neutral prologue forces the full algorithm to run.
+        ['Hello, world! 123', 'Ελληνικά\t3.14 — Кириллица', 'áb']
+        .forEach(function(text) {
+            var p = ubidi.Paragraph(text);
+            var q = ubidi.Paragraph(text, { prologue: ' ' });
+            p.getDirection().should.equal(q.getDirection());
+            p.getParaLevel().should.equal(q.getParaLevel());
+            p.countRuns().should.equal(q.countRuns());
+            p.getResultLength().should.equal(q.getResultLength());
+            Array.from(p.getLevels()).should.eql(Array.from(q.getLevels()));
+            Array.from(p.getRuns()).should.eql(Array.from(q.getRuns()));
+            Array.from(p.getVisualMap()).should.eql(
+                Array.from(q.getVisualMap())
+            );
+            p.writeReordered().should.equal(text);
+            p.getVisualRun(0).should.eql(q.getVisualRun(0));
+            p.getParagraph(0).should.eql(q.getParagraph(0));
+            p.setLine(1, 3).writeReordered().should.equal(text.slice(1, 3));
+        });
+        var p = ubidi.Paragraph('plain');
+        p.reset('עִבְרִית').getDirection().should.equal('rtl');
+        p.reset('plain again').getDirection().should.equal('ltr');
+    });
+    it('should find the base direction of text', function() {
+        ubidi.getBaseDirection('abc אב').should.equal('ltr');
+        ubidi.getBaseDirection('123 אב').should.equal('rtl');
+        ubidi.getBaseDirection('123').should.equal('neutral');
+        ubidi.getBaseDirection('').should.equal('neutral');
+        ubidi.getBaseDirection(' '.repeat(300) + '𐤀').
+            should.equal('rtl');
+        ubidi.getBaseDirection(Buffer.from('.. אב')).should.equal('rtl');
+        ubidi.getBaseDirection(Buffer.from('.. ab', 'utf16le'), {
+            encoding: 'utf16le'
+        }).should.equal('ltr');
+    });
+    it('should write reordered text into arrays and buffers', function() {
+        var text = 'English עִבְרִית 123 ';
+        var p = ubidi.Paragraph(text);
+        var expected = p.writeReordered();
+        var u16 = new Uint16Array(text.length + 2);
+        p.writeReorderedInto(u16).should.equal(expected.length);
+        String.fromCharCode.apply(null, u16.subarray(0, expected.length)).
+            should.equal(expected);
+        var buf = Buffer.alloc(64);
+        var n = p.writeReorderedInto(buf);
+        buf.slice(0, n).toString().should.equal(expected);
+        p.writeReorderedUtf8().toString().should.equal(expected);
+        p.writeReorderedUtf8(ubidi.Reordered.DO_MIRRORING).toString().
+            should.equal(p.writeReordered(ubidi.Reordered.DO_MIRRORING));
+        (function() {
+            p.writeReorderedInto(new Uint16Array(3));
+        }).should.throw(RangeError);
+        (function() {
+            p.writeReorderedInto(Buffer.alloc(3));
+        }).should.throw(RangeError);
+        (function() {
+            p.writeReorderedInto(new Int32Array(64));
+        }).should.throw(TypeError);
+        // long text is not limited by the size of the stack
+        var long = new Array(100001).join(text);
+        ubidi.Paragraph(long).writeReordered().length.should.equal(long.length);
+    });
+    it('should shape and reorder Arabic text', function() {
+        var p = ubidi.Paragraph('abc \u0633\u0644\u0627\u0645 12');
+        // seen (initial), lam-alef (final), meem (isolated), reversed.
+        p.shapeAndReorder().should.equal('abc 12 \ufee1\ufefc\ufeb3');
+        p.shapeAndReorder(
+            ubidi.Shape.LETTERS_SHAPE | ubidi.Shape.DIGITS_EN2AN,
+            ubidi.Reordered.OUTPUT_REVERSE
+        ).should.equal('\ufeb3\ufefc\ufee1 \u0662\u0661 cba');
+        // Mirroring happens before shaping.
+        var q = ubidi.Paragraph('\u0644\u0627 (1)');
+        q.shapeAndReorder(ubidi.Shape.LETTERS_SHAPE,
+                          ubidi.Reordered.DO_MIRRORING)
+            .should.equal('(1) \ufefb');
+        q.shapeAndReorder(ubidi.Shape.LETTERS_NOOP)
+            .should.equal(q.writeReordered());
+        ubidi.Paragraph('').shapeAndReorder().should.equal('');
+        // Long text is not limited by the size of the stack.
+        var long = new Array(1001).join('\u0633\u0644\u0627\u0645 ');
+        ubidi.Paragraph(long).shapeAndReorder().length
+            .should.equal(long.length - 1000);
+        // Unshaping can make the text longer.
+        var unshape = ubidi.Shape.LETTERS_UNSHAPE |
+            ubidi.Shape.LENGTH_GROW_SHRINK;
+        ubidi.Paragraph('\ufefb').shapeAndReorder(unshape)
+            .should.equal('\u0627\u0644');
+        long = new Array(1001).join('\ufefb ');
+        var unshaped = ubidi.Paragraph(long).shapeAndReorder(unshape);
+        unshaped.length.should.equal(long.length + 1000);
+        unshaped.indexOf('\ufefb').should.equal(-1);
+    });
+    it('should give the same answers from optimized loops', function() {
+        // Enough calls for V8 to optimize them (and use fast calls, if
+        // it can), including calls which have to take the slow path.
+        var text = 'abc \u05d0\u05d1\u05d2 (123) def';
+        var p = ubidi.Paragraph(text);
+        var levels = p.getLevels(), map = p.getVisualMap();
+        var q = ubidi.Paragraph('plain');
+        for (var n = 0; n < 2000; n++) {
+            p.getLength().should.equal(text.length);
+            q.getLevelAt(n % 5).should.equal(0);
+            var i = n % text.length;
+            p.getLevelAt(i).should.equal(levels[i]);
+            p.getVisualIndex(map[i]).should.equal(i);
+            p.getLogicalIndex(i).should.equal(map[i]);
+        }
+        (function() { p.getVisualIndex(100); }).should.throw();
+        p.close();
+        (function() { p.getLength(); }).should.throw();
+        (function() { p.getLevelAt(0); }).should.throw();
+    });
+    it('should map ranges between logical and visual order', function() {
+        var p = ubidi.Paragraph('abc \u05d0\u05d1\u05d2 def');
+        // "abc " [level 0] + "gba" [1] + " def" [0] visually.
+        var r = p.logicalRangesToVisual(new Int32Array([2, 6, 8, 8]));
+        Array.from(r.segments).should.eql([2, 4, 0, 5, 7, 1]);
+        Array.from(r.segmentIndex).should.eql([0, 2, 2]);
+        r = p.visualRangesToLogical(new Int32Array([3, 6, 0, 11]));
+        Array.from(r.segments).should.eql([
+            3, 4, 0, 5, 7, 1,
+            0, 4, 0, 4, 7, 1, 7, 11, 0
+        ]);
+        Array.from(r.segmentIndex).should.eql([0, 2, 5]);
+        // Every character of a range appears once on the other side.
+        var map = p.getVisualMap();
+        r = p.visualRangesToLogical(new Int32Array([1, 9]));
+        var seen = [];
+        for (var i = 0; i < r.segments.length; i += 3) {
+            for (var j = r.segments[i]; j < r.segments[i + 1]; j++) {
+                seen.push(j);
+            }
+        }
+        seen.should.eql(Array.from(map.subarray(1, 9)).sort());
+        ubidi.Paragraph('plain text').logicalRangesToVisual(
+            new Int32Array([1, 4])
+        ).segments.length.should.equal(3);
+        (function() {
+            p.logicalRangesToVisual(new Int32Array([0, 20]));
+        }).should.throw(RangeError);
+        (function() {
+            p.logicalRangesToVisual(new Int32Array([0]));
+        }).should.throw(RangeError);
+        (function() {
+            p.logicalRangesToVisual([0, 1]);
+        }).should.throw(TypeError);
+    });
+    it('should lay out all lines at once', function() {
+        var text = 'English עִבְרִית (123) more English';
+        var breaks = new Int32Array([8, 16, 16, 22]);
+        var p = ubidi.Paragraph(text);
+        var layout = p.layoutLines(breaks, ubidi.Reordered.DO_MIRRORING);
+        layout.text.length.should.equal(5);
+        layout.runIndex.length.should.equal(6);
+        var starts = [0, 8, 16, 16, 22, text.length];
+        for (var i = 0; i < 5; i++) {
+            if (starts[i] === starts[i + 1]) {
+                layout.text[i].should.equal('');
+                layout.runIndex[i].should.equal(layout.runIndex[i + 1]);
+                continue;
+            }
+            var line = p.setLine(starts[i], starts[i + 1]);
+            layout.text[i].should.equal(
+                line.writeReordered(ubidi.Reordered.DO_MIRRORING)
+            );
+            var runs = line.getRuns();
+            for (var j = 0; j < runs.length; j += 3) { runs[j] += starts[i]; }
+            Array.from(layout.runs.subarray(
+                3 * layout.runIndex[i], 3 * layout.runIndex[i + 1]
+            )).should.eql(Array.from(runs));
+        }
+        ubidi.Paragraph('plain text').layoutLines(new Int32Array([6])).
+            text.should.eql(['plain ', 'text']);
+        (function() {
+            p.layoutLines(new Int32Array([8, 4]));
+        }).should.throw(RangeError);
+        (function() {
+            p.layoutLines([8]);
+        }).should.throw(TypeError);
+    });
+    it('should accept explicit embedding levels', function() {
+        var text = 'abc def ghi';
+        var levels = new Uint8Array(text.length);
+        for (var i = 4; i < 7; i++) { levels[i] = 1 | ubidi.LEVEL_OVERRIDE; }
+        var copy = Array.from(levels);
+        var p = ubidi.Paragraph(text, {
+            paraLevel: ubidi.LTR,
+            embeddingLevels: levels
+        });
+        p.writeReordered().should.equal('abc fed ghi');
+        p.getLevelAt(5).should.equal(1);
+        p.getDirection().should.equal('mixed');
+        // The levels are copied: ICU doesn't write to the array, and it
+        // can be reused as soon as the Paragraph has been made.
+        Array.from(levels).should.eql(copy);
+        var q = ubidi.Paragraph(text, {
+            paraLevel: ubidi.LTR,
+            embeddingLevels: levels
+        });
+        levels.fill(0);
+        q.writeReordered().should.equal('abc fed ghi');
+        (function() {
+            ubidi.Paragraph(text, { embeddingLevels: new Uint8Array(3) });
+        }).should.throw();
+        (function() {
+            ubidi.Paragraph(text, { embeddingLevels: [0, 1, 2] });
+        }).should.throw(TypeError);
+    });
+    it('should only run the bidi algorithm when needed', function() {
+        var h = 'עִבְרִית';
+        var before = ubidi.stats().setParaCalls;
+        var p = ubidi.Paragraph('123 ' + h + ' abc');
+        p.getLength().should.equal(h.length + 8);
+        p.getProcessedLength().should.equal(h.length + 8);
+        p.getResultLength().should.equal(h.length + 8);
+        p.getParaLevel().should.equal(1);
+        ubidi.Paragraph(h, { paraLevel: ubidi.DEFAULT_LTR })
+            .getParaLevel().should.equal(1);
+        ubidi.Paragraph('\u2067' + h + '\u2069 abc').getParaLevel()
+            .should.equal(0);
+        ubidi.stats().setParaCalls.should.equal(before);
+        p.countRuns().should.equal(3);
+        p.getParaLevel().should.equal(1);
+        ubidi.stats().setParaCalls.should.equal(before + 1);
+    });
+    it('should resolve UTF-16 text before it can change', function() {
+        var h = 'עברית';
+        var text = new Uint16Array(h.length);
+        for (var i = 0; i < h.length; i++) { text[i] = h.charCodeAt(i); }
+        var p = ubidi.Paragraph(text);
+        // Whether or not `text` was used in place, the paragraph
+        // describes it as it was when the paragraph was created.
+        text.fill(0x61);
+        p.countRuns().should.equal(1);
+        p.getVisualRun(0).dir.should.equal('rtl');
+        Array.from(p.getLevels()).should.eql([1, 1, 1, 1, 1]);
+    });
+    it('should share cached results', function() {
+        var e = 'English';
+        var h = 'עִבְרִית';
+        var text = e + ' (' + h + ') 123';
+        var expected = ubidi.Paragraph(text).writeReordered();
+        var before = ubidi.stats();
+        ubidi.setCacheSize(4);
+        try {
+            var p = ubidi.Paragraph(text);
+            var q = ubidi.Paragraph(new Uint16Array(
+                text.split('').map(function(c) { return c.charCodeAt(0); })
+            ));
+            p.writeReordered().should.equal(expected);
+            q.writeReordered().should.equal(expected);
+            Array.from(q.getLevels()).should.eql(Array.from(p.getLevels()));
+            // Different options give different results.
+            ubidi.Paragraph(text, { paraLevel: ubidi.RTL }).
+                writeReordered().should.not.equal(expected);
+            // Resetting one paragraph doesn't affect the other.
+            p.reset(h);
+            q.writeReordered().should.equal(expected);
+            q.setLine(0, 3).writeReordered().should.equal(e.slice(0, 3));
+            var after = ubidi.stats();
+            // (p's new text is never needed, so it's never resolved.)
+            (after.cacheMisses - before.cacheMisses).should.equal(2);
+            (after.cacheHits - before.cacheHits).should.equal(1);
+        } finally {
+            ubidi.setCacheSize(0);
+        }
+    });
 });
@@ -0,0 +1,72 @@
+// Check the parallel document API.
+require('should');
+
+describe('Document processing', function() {
+    var ubidi = require('../');
+    var e = 'English';
+    var h = 'עִבְרִית';
+    var text = '', i;
+    // Large enough to be split into several pieces.
+    for (i = 0; i < 12000; i++) {
+        text += (i % 2 ? e + ' (' + i + ' ' + h + ')' :
+                 h + ' ' + e + ' ' + i) + (i % 3 ? '\n' : '\r\n');
+    }
+    it('should match a single Paragraph', function() {
+        return ubidi.processDocument(text, {
+            concurrency: 4,
+            writeOptions: ubidi.Reordered.DO_MIRRORING
+        }).then(function(doc) {
+            var p = ubidi.Paragraph(text, { reorderParagraphsLTR: true });
+            doc.getLength().should.equal(p.getLength());
+            doc.getParaLevel().should.equal(p.getParaLevel());
+            doc.getDirection().should.equal(p.getDirection());
+            doc.countParagraphs().should.equal(p.countParagraphs());
+            doc.countRuns().should.equal(p.countRuns());
+            Array.from(doc.getLevels()).should.eql(Array.from(p.getLevels()));
+            Array.from(doc.getRuns()).should.eql(Array.from(p.getRuns()));
+            doc.getParagraphByIndex(7777).should.eql(
+                p.getParagraphByIndex(7777)
+            );
+            doc.getParagraph(123456).should.eql(p.getParagraph(123456));
+            doc.getVisualRun(1000).should.eql(p.getVisualRun(1000));
+            doc.writeReordered().should.equal(
+                p.writeReordered(ubidi.Reordered.DO_MIRRORING)
+            );
+        });
+    });
+    it('should add up the lengths of the pieces', function() {
+        // Controls which REMOVE_CONTROLS leaves out of the result.
+        var marked = text.replace(/\n/g, '\u200f\n');
+        var options = {
+            reorderingOptions: ubidi.ReorderingOption.REMOVE_CONTROLS
+        };
+        return ubidi.processDocument(marked, options).then(function(doc) {
+            var p = ubidi.Paragraph(marked, {
+                reorderParagraphsLTR: true,
+                reorderingOptions: options.reorderingOptions
+            });
+            doc.getProcessedLength().should.equal(p.getProcessedLength());
+            doc.getResultLength().should.equal(p.getResultLength());
+            doc.getResultLength().should.be.below(doc.getLength());
+        });
+    });
+    it('should reject reorderParagraphsLTR: false', function() {
+        (function() {
+            ubidi.processDocument(text, { reorderParagraphsLTR: false },
+                                  function() {});
+        }).should.throw(TypeError);
+    });
+    it('should handle small documents', function(done) {
+        ubidi.processDocument(h + '\n' + e, function(err, doc) {
+            if (err) { return done(err); }
+            doc.countParagraphs().should.equal(2);
+            doc.getDirection().should.equal('mixed');
+            doc.writeReordered().should.equal(
+                ubidi.Paragraph(h + '\n' + e, {
+                    reorderParagraphsLTR: true
+                }).writeReordered()
+            );
+            done();
+        });
+    });
+});
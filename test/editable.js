@@ -0,0 +1,113 @@
+// Check that editable paragraphs match paragraphs made from scratch.
+require('should');
+
+describe('Editable paragraphs', function() {
+    var ubidi = require('../');
+    var e = 'English';
+    var h = 'עִבְרִית';
+    var check = function(ep) {
+        var text = ep.getText();
+        var p = ubidi.Paragraph(text, { reorderParagraphsLTR: true });
+        ep.getLength().should.equal(p.getLength());
+        ep.countParagraphs().should.equal(p.countParagraphs());
+        ep.getParaLevel().should.equal(p.getParaLevel());
+        ep.getDirection().should.equal(p.getDirection());
+        Array.from(ep.getLevels()).should.eql(Array.from(p.getLevels()));
+        Array.from(ep.getRuns()).should.eql(Array.from(p.getRuns()));
+        ep.writeReordered().should.equal(p.writeReordered());
+        for (var i = 0; i < ep.countParagraphs(); i++) {
+            ep.getParagraphByIndex(i).should.eql(p.getParagraphByIndex(i));
+        }
+    };
+    it('should match a Paragraph after each edit', function() {
+        var ep = ubidi.EditableParagraph(
+            e + ' ' + h + '\n' + h + ' 123\r\n' + e
+        );
+        check(ep);
+        check(ep.edit(0, 0, h + ' '));            // insert at the start
+        check(ep.edit(ep.getLength(), 0, '\n'));  // add an empty paragraph
+        check(ep.edit(5, 3, '\n' + e + ' (1) ')); // split a paragraph
+        var cr = ep.getText().indexOf('\r');
+        check(ep.edit(cr, 1));                    // CR LF becomes LF
+        check(ep.edit(cr, 0, '\r'));              // and back again
+        check(ep.edit(cr + 1, 0, 'x'));           // LF joins the next line
+        check(ep.edit(0, ep.getLength(), h));     // replace everything
+        check(ep.edit(0, ep.getLength()));        // delete everything
+        ep.getText().should.equal('');
+        check(ep.edit(0, 0, e + '\n' + h));
+        ep.getLevelAt(e.length + 2).should.equal(1);
+        ep.getVisualRun(1).should.eql({
+            dir: 'rtl', logicalStart: e.length + 1, length: h.length
+        });
+        ep.close();
+    });
+    it('should only resolve the paragraphs which changed', function() {
+        var lines = [];
+        for (var i = 0; i < 100; i++) {
+            lines.push(i % 2 ? e + ' ' + i + ' ' + h : h + ' ' + i + ' ' + e);
+        }
+        var ep = ubidi.EditableParagraph(lines.join('\n'));
+        ep.getLevels();
+        var before = ubidi.stats();
+        var at = ep.getParagraphByIndex(50).start;
+        ep.edit(at, 2, h);
+        ep.getLevels();
+        var after = ubidi.stats();
+        (after.paragraphsCreated - before.paragraphsCreated).should.equal(0);
+        (after.setParaCalls - before.setParaCalls).should.equal(1);
+        check(ep);
+        ep.close();
+    });
+    it('should keep paragraphs with the one they depend on', function() {
+        // ICU lets the Arabic letter decide the direction of the number
+        // in the next paragraph.
+        var a = '\u0627';
+        var ep = ubidi.EditableParagraph(a + '\n1 ' + e);
+        check(ep);
+        check(ep.edit(a.length + 1, 1, e));       // now starts strongly
+        check(ep.edit(a.length + 1, e.length, '2')); // and neutrally again
+        check(ep.edit(0, 0, '3\n'));
+        ep.close();
+    });
+    it('should not rebuild its tables until it is edited', function() {
+        var ep = ubidi.EditableParagraph(e + ' ' + h + '\n' + h + ' ' + e);
+        var runs = ep.getRuns();
+        runs[0] = 42;
+        ep.getRuns()[0].should.equal(0);
+        ep.getRuns().should.not.equal(ep.getRuns());
+        ep.getVisualRun(1).logicalStart.should.equal(e.length + 1);
+        ep.edit(0, e.length + 1);
+        check(ep);
+        runs = ep.getRuns();
+        ep.countRuns().should.equal(runs.length / 3);
+        ep.getVisualRun(1).logicalStart.should.equal(runs[3]);
+        ep.close();
+    });
+    it('should keep the prologue and epilogue at the ends', function() {
+        var options = { prologue: h, epilogue: h };
+        var ep = ubidi.EditableParagraph('123\n' + e + '\n456', options);
+        ep.edit(0, 4);
+        ep.edit(ep.getLength() - 4, 4);
+        var p = ubidi.Paragraph(e, options);
+        Array.from(ep.getLevels()).should.eql(Array.from(p.getLevels()));
+        ep.close();
+    });
+    it('should reject reorderParagraphsLTR: false', function() {
+        (function() {
+            ubidi.EditableParagraph(e + '\n' + h, {
+                reorderParagraphsLTR: false
+            });
+        }).should.throw(TypeError);
+        var ep = ubidi.EditableParagraph(e + '\n' + h, {
+            reorderParagraphsLTR: true
+        });
+        check(ep);
+        ep.close();
+    });
+    it('should reject edits outside the text', function() {
+        var ep = ubidi.EditableParagraph(e);
+        (function() { ep.edit(-1, 0, 'x'); }).should.throw(RangeError);
+        (function() { ep.edit(5, 5); }).should.throw(RangeError);
+        ep.close();
+    });
+});
@@ -0,0 +1,85 @@
+// Check the stats counters and trace events.
+require('should');
+var childProcess = require('child_process');
+var fs = require('fs');
+var path = require('path');
+
+describe('Stats', function() {
+    var ubidi = require('../');
+    var h = 'עִבְרִית';
+    it('should count paragraphs, lines and calls', function() {
+        var before = ubidi.stats();
+        var p = ubidi.Paragraph('English ' + h);
+        var line = p.setLine(0, 4);
+        p.writeReordered();
+        line.writeReordered();
+        var after = ubidi.stats();
+        (after.paragraphsCreated - before.paragraphsCreated).should.equal(1);
+        (after.paragraphsLive - before.paragraphsLive).should.equal(1);
+        (after.linesCreated - before.linesCreated).should.equal(1);
+        (after.linesLive - before.linesLive).should.equal(1);
+        (after.bytesProcessed - before.bytesProcessed).should.equal(
+            2 * ('English ' + h).length
+        );
+        (after.setParaCalls - before.setParaCalls).should.equal(1);
+        (after.writeReorderedCalls - before.writeReorderedCalls)
+            .should.equal(2);
+        after.setParaTime.should.be.above(before.setParaTime);
+        after.nativeBytes.should.be.above(before.nativeBytes);
+        p.close();
+        ubidi.stats().nativeBytes.should.be.below(after.nativeBytes);
+    });
+    it('should size lines to fit', function() {
+        var text = new Array(10001).join('English ' + h + ' ');
+        var p = ubidi.Paragraph(text);
+        p.writeReordered();
+        var before = ubidi.stats().nativeBytes;
+        var line = p.setLine(0, 10);
+        // Much less than the 2 bytes per character of the paragraph.
+        (ubidi.stats().nativeBytes - before).should.be.below(2 * 1024);
+        line.writeReordered().length.should.equal(10);
+    });
+    it('should count work done in batches', function() {
+        var before = ubidi.stats();
+        return ubidi.processBatch([h, 'English']).then(function() {
+            var after = ubidi.stats();
+            (after.bytesProcessed - before.bytesProcessed).should.equal(
+                2 * (h.length + 'English'.length)
+            );
+            // plain LTR text doesn't need ICU.
+            (after.setParaCalls - before.setParaCalls).should.equal(1);
+        });
+    });
+    it('should record trace events when asked', function(done) {
+        try {
+            require('trace_events');
+        } catch (e) {
+            return this.skip(); // node < 10
+        }
+        var script = [
+            "var ubidi = require(" + JSON.stringify(path.join(__dirname, '..')) + ");",
+            "ubidi.Paragraph('" + h + "').setLine(0, 2).writeReordered();",
+            "ubidi.processBatch(['" + h + "']);"
+        ].join('\n');
+        var log = path.join(require('os').tmpdir(),
+                            'icu-bidi-test-${pid}.log');
+        var child = childProcess.execFile(process.execPath, [
+            '--trace-event-categories', 'icu-bidi',
+            '--trace-event-file-pattern', log,
+            '-e', script
+        ], function(err) {
+            if (err) { return done(err); }
+            var file = log.replace('${pid}', child.pid);
+            var events = JSON.parse(fs.readFileSync(file, 'utf8')).traceEvents;
+            fs.unlinkSync(file);
+            var names = events.filter(function(e) {
+                return e.cat === 'icu-bidi';
+            }).map(function(e) { return e.name; }).sort();
+            names.should.eql([
+                'Paragraph', 'Paragraph#setLine', 'Paragraph#writeReordered',
+                'processBatch', 'processBatch (worker)'
+            ]);
+            done();
+        });
+    });
+});
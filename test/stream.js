@@ -0,0 +1,73 @@
+// Check the streaming API.
+require('should');
+
+describe('Reorder stream', function() {
+    var ubidi = require('../');
+    var e = 'English';
+    var h = 'עִבְרִית';
+    var collect = function(stream, done) {
+        var chunks = [];
+        stream.on('data', function(chunk) { chunks.push(chunk); });
+        stream.on('error', done);
+        stream.on('end', function() {
+            done(null, Buffer.concat(chunks).toString());
+        });
+    };
+    it('should reorder text split across chunks', function(done) {
+        var text = '', i;
+        for (i = 0; i < 200; i++) {
+            text += '(' + i + ' ' + h + ') ' + e + '\n';
+        }
+        text += h + ' ' + e;
+        var options = { writeOptions: ubidi.Reordered.DO_MIRRORING };
+        var expected = ubidi.Paragraph(text, {
+            reorderParagraphsLTR: true
+        }).writeReordered(options.writeOptions);
+        var stream = ubidi.createReorderStream(options);
+        collect(stream, function(err, result) {
+            if (err) { return done(err); }
+            result.should.equal(expected);
+            done();
+        });
+        // Split the UTF-8 bytes at awkward places.
+        var buf = Buffer.from(text);
+        for (i = 0; i < buf.length; i += 7) {
+            stream.write(buf.slice(i, i + 7));
+        }
+        stream.end();
+    });
+    it('should keep the prologue until a paragraph is written', function(done) {
+        // The prologue decides the direction of the first paragraph,
+        // which arrives in two chunks.
+        var options = { prologue: h };
+        var expected = ubidi.Paragraph('(1 2)\n' + e, {
+            prologue: h, reorderParagraphsLTR: true
+        }).writeReordered();
+        expected.should.not.equal(ubidi.Paragraph('(1 2)\n' + e, {
+            reorderParagraphsLTR: true
+        }).writeReordered());
+        var stream = ubidi.createReorderStream(options);
+        collect(stream, function(err, result) {
+            if (err) { return done(err); }
+            result.should.equal(expected);
+            done();
+        });
+        stream.write('(1 ');
+        stream.write('2)\n');
+        stream.end(e);
+    });
+    it('should break overlong paragraphs', function(done) {
+        var stream = ubidi.createReorderStream({ maxParagraphLength: 8 });
+        collect(stream, function(err, result) {
+            if (err) { return done(err); }
+            result.should.equal(
+                ubidi.Paragraph(e + ' ').writeReordered() +
+                ubidi.Paragraph(h).writeReordered() +
+                ubidi.Paragraph(' ' + e).writeReordered()
+            );
+            done();
+        });
+        stream.write(e + ' ' + h);
+        stream.end(' ' + e);
+    });
+});
@@ -0,0 +1,58 @@
+// Check that the module can be used from several worker threads at once.
+require('should');
+var path = require('path');
+
+describe('Worker threads', function() {
+    var ubidi = require('../');
+    var W;
+    try {
+        W = require('worker_threads');
+    } catch (e) {
+        W = null; // node < 10, or node 10 without --experimental-worker
+    }
+    var h = 'עִבְרִית';
+    var texts = [];
+    for (var i = 0; i < 100; i++) {
+        texts.push('(' + i + ' ' + h + ') English ' + h);
+    }
+    var source = [
+        "var W = require('worker_threads');",
+        "var ubidi = require(" + JSON.stringify(path.join(__dirname, '..')) + ");",
+        "ubidi.setCacheSize(W.workerData.id % 2 ? 16 : 0);",
+        "var reordered = W.workerData.texts.map(function(text) {",
+        "  return ubidi.Paragraph(text).writeReordered();",
+        "});",
+        "ubidi.processBatch(W.workerData.texts, function(err, results) {",
+        "  if (err) { throw err; }",
+        "  W.parentPort.postMessage({",
+        "    reordered: reordered,",
+        "    batch: results.map(function(r) { return r.reordered; }),",
+        "    paragraphsCreated: ubidi.stats().paragraphsCreated",
+        "  });",
+        "});"
+    ].join('\n');
+    it('should give the same answers in every worker', function() {
+        if (!W) { return this.skip(); }
+        var expected = texts.map(function(text) {
+            return ubidi.Paragraph(text).writeReordered();
+        });
+        var workers = [0, 1, 2, 3].map(function(id) {
+            return new Promise(function(resolve, reject) {
+                var worker = new W.Worker(source, {
+                    eval: true,
+                    workerData: { id: id, texts: texts }
+                });
+                worker.on('message', resolve);
+                worker.on('error', reject);
+            });
+        });
+        return Promise.all(workers).then(function(results) {
+            results.forEach(function(result) {
+                result.reordered.should.eql(expected);
+                result.batch.should.eql(expected);
+                // Each worker has its own stats.
+                result.paragraphsCreated.should.equal(texts.length);
+            });
+        });
+    });
+});